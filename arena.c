@@ -0,0 +1,249 @@
+#include "arena.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct memRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} memRange;
+
+struct memBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint8_t* mapped;
+    uint32_t memoryType;
+    uint32_t linear;
+    //made for a single request too big to share a block, freed with it
+    uint32_t dedicated;
+    //the pieces handed out, sorted by offset. the gaps are the free space
+    memRange* ranges;
+    uint32_t numRanges;
+    uint32_t capacity;
+    memBlock* next;
+};
+
+//alignments are powers of two
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void initArena(ctx* ctx) {
+    memArena* a = &ctx->arena;
+    vkGetPhysicalDeviceMemoryProperties(ctx->physicalDevice, &a->props);
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->physicalDevice, &props);
+    a->nonCoherentAtomSize = props.limits.nonCoherentAtomSize
+        ? props.limits.nonCoherentAtomSize : 1;
+}
+
+static memBlock* createBlock(ctx* ctx, uint32_t memoryType, VkDeviceSize size, int linear,
+        int dedicated) {
+    memArena* a = &ctx->arena;
+    memBlock* block = calloc(1, sizeof(memBlock));
+    if (!block) {
+        fprintf(stderr, "ERROR: Couldn't allocate memory block bookkeeping\n");
+        return NULL;
+    }
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryType,
+    };
+    if (vkAllocateMemory(ctx->logicalDevice, &allocInfo, NULL, &block->memory)
+            != VK_SUCCESS) {
+        free(block);
+        return NULL;
+    }
+    if (a->props.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void* mapped;
+        if (vkMapMemory(ctx->logicalDevice, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped)
+                != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't map memory block\n");
+            vkFreeMemory(ctx->logicalDevice, block->memory, NULL);
+            free(block);
+            return NULL;
+        }
+        block->mapped = mapped;
+    }
+    block->size = size;
+    block->memoryType = memoryType;
+    block->linear = linear;
+    block->dedicated = dedicated;
+
+    block->next = a->blocks;
+    a->blocks = block;
+    a->numBlocks++;
+    a->reserved += size;
+    if (a->reserved > a->peakReserved) {
+        a->peakReserved = a->reserved;
+    }
+    return block;
+}
+
+static void destroyBlock(ctx* ctx, memBlock* block) {
+    memArena* a = &ctx->arena;
+    for (memBlock** b = &a->blocks; *b; b = &(*b)->next) {
+        if (*b == block) {
+            *b = block->next;
+            break;
+        }
+    }
+    if (block->mapped) { vkUnmapMemory(ctx->logicalDevice, block->memory); }
+    vkFreeMemory(ctx->logicalDevice, block->memory, NULL);
+    a->numBlocks--;
+    a->reserved -= block->size;
+    free(block->ranges);
+    free(block);
+}
+
+//first fit. index is where the new range goes in block->ranges
+static int findGap(const memBlock* block, VkDeviceSize size, VkDeviceSize alignment,
+        VkDeviceSize* offset, uint32_t* index) {
+    VkDeviceSize start = 0;
+    for (uint32_t i = 0; i <= block->numRanges; i++) {
+        VkDeviceSize end = i < block->numRanges ? block->ranges[i].offset : block->size;
+        VkDeviceSize aligned = alignUp(start, alignment);
+        if (aligned + size <= end) {
+            *offset = aligned;
+            *index = i;
+            return true;
+        }
+        if (i < block->numRanges) {
+            start = block->ranges[i].offset + block->ranges[i].size;
+        }
+    }
+    return false;
+}
+
+static int insertRange(memBlock* block, uint32_t index, VkDeviceSize offset,
+        VkDeviceSize size) {
+    if (block->numRanges == block->capacity) {
+        uint32_t capacity = block->capacity ? block->capacity * 2 : 16;
+        memRange* ranges = realloc(block->ranges, capacity * sizeof(memRange));
+        if (!ranges) {
+            fprintf(stderr, "ERROR: Couldn't grow memory block bookkeeping\n");
+            return false;
+        }
+        block->ranges = ranges;
+        block->capacity = capacity;
+    }
+    memmove(&block->ranges[index + 1], &block->ranges[index],
+            (block->numRanges - index) * sizeof(memRange));
+    block->ranges[index].offset = offset;
+    block->ranges[index].size = size;
+    block->numRanges++;
+    return true;
+}
+
+int arenaAllocType(ctx* ctx, const VkMemoryRequirements* reqs, uint32_t memoryType,
+        int linear, memAlloc* out) {
+    memArena* a = &ctx->arena;
+    VkMemoryPropertyFlags flags = a->props.memoryTypes[memoryType].propertyFlags;
+    VkDeviceSize size = reqs->size;
+    VkDeviceSize alignment = reqs->alignment ? reqs->alignment : 1;
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+            && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        if (alignment < a->nonCoherentAtomSize) {
+            alignment = a->nonCoherentAtomSize;
+        }
+        size = alignUp(size, a->nonCoherentAtomSize);
+    }
+
+    memBlock* block = NULL;
+    VkDeviceSize offset = 0;
+    uint32_t index = 0;
+    if (size <= ARENA_BLOCK_SIZE / 2) {
+        for (memBlock* b = a->blocks; b; b = b->next) {
+            if (!b->dedicated && b->memoryType == memoryType && b->linear == (uint32_t) linear
+                    && findGap(b, size, alignment, &offset, &index)) {
+                block = b;
+                break;
+            }
+        }
+        if (!block) {
+            block = createBlock(ctx, memoryType, ARENA_BLOCK_SIZE, linear, false);
+            offset = 0;
+            index = 0;
+        }
+    }
+    //big requests, and small ones when a whole block doesn't fit the heap anymore
+    if (!block) {
+        block = createBlock(ctx, memoryType, size, linear, true);
+        offset = 0;
+        index = 0;
+    }
+    if (!block) {
+        fprintf(stderr, "ERROR: Couldn't allocate %llu bytes of device memory\n",
+                (unsigned long long) size);
+        return false;
+    }
+    if (!insertRange(block, index, offset, size)) {
+        if (block->dedicated) {
+            destroyBlock(ctx, block);
+        }
+        return false;
+    }
+
+    out->memory = block->memory;
+    out->offset = offset;
+    out->size = size;
+    out->mapped = block->mapped ? block->mapped + offset : NULL;
+    out->block = block;
+    a->numAllocs++;
+    a->used += size;
+    return true;
+}
+
+int arenaAlloc(ctx* ctx, const VkMemoryRequirements* reqs, VkMemoryPropertyFlags properties,
+        int linear, memAlloc* out) {
+    uint32_t memoryType;
+    if (!findMemoryType(reqs->memoryTypeBits, properties, ctx->physicalDevice, &memoryType)) {
+        return false;
+    }
+    return arenaAllocType(ctx, reqs, memoryType, linear, out);
+}
+
+void arenaFree(ctx* ctx, memAlloc* alloc) {
+    memArena* a = &ctx->arena;
+    memBlock* block = alloc->block;
+    if (!block) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < block->numRanges; i++) {
+        if (block->ranges[i].offset == alloc->offset) {
+            memmove(&block->ranges[i], &block->ranges[i + 1],
+                    (block->numRanges - i - 1) * sizeof(memRange));
+            block->numRanges--;
+            a->numAllocs--;
+            a->used -= alloc->size;
+            break;
+        }
+    }
+    //shared blocks stay around empty, the next allocation of the kind reuses them
+    if (block->dedicated && block->numRanges == 0) {
+        destroyBlock(ctx, block);
+    }
+    memset(alloc, 0, sizeof(memAlloc));
+}
+
+void arenaReport(ctx* ctx) {
+    memArena* a = &ctx->arena;
+    fprintf(stdout, "memory: %.1f MB reserved in %u blocks, %.1f MB used by %u allocations, "
+            "peak %.1f MB reserved\n", a->reserved / 1048576.0, a->numBlocks,
+            a->used / 1048576.0, a->numAllocs, a->peakReserved / 1048576.0);
+}
+
+void destroyArena(ctx* ctx) {
+    memArena* a = &ctx->arena;
+    if (a->numAllocs) {
+        fprintf(stderr, "WARNING: %u device memory allocations still live at shutdown\n",
+                a->numAllocs);
+    }
+    while (a->blocks) {
+        destroyBlock(ctx, a->blocks);
+    }
+}
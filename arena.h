@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "vulkan.h"
+
+//device memory is allocated in large blocks per memory type and handed out
+//in aligned pieces, instead of one vkAllocateMemory per buffer and image.
+//keeps the allocation count far below maxMemoryAllocationCount and lets
+//freed pieces be reused. host visible blocks stay mapped for their whole
+//life, memAlloc.mapped points at the piece. not thread safe, everything
+//allocates from the render thread
+
+//blocks are this large unless a single request needs more
+#define ARENA_BLOCK_SIZE (64ull << 20)
+
+//needs the physical device, before anything is allocated
+void initArena(ctx* ctx);
+
+//reqs from vkGet*MemoryRequirements. linear is true for buffers and false
+//for optimal tiling images, which are kept in separate blocks so
+//bufferImageGranularity never matters
+int arenaAlloc(ctx* ctx, const VkMemoryRequirements* reqs, VkMemoryPropertyFlags properties,
+        int linear, memAlloc* out);
+//same with the memory type already picked
+int arenaAllocType(ctx* ctx, const VkMemoryRequirements* reqs, uint32_t memoryType,
+        int linear, memAlloc* out);
+//the piece can be reused right away, so whatever used it must be done with it.
+//a zeroed memAlloc is ignored
+void arenaFree(ctx* ctx, memAlloc* alloc);
+
+//bytes reserved in blocks against bytes handed out
+void arenaReport(ctx* ctx);
+void destroyArena(ctx* ctx);
+
+#endif
@@ -0,0 +1,220 @@
+#include "bench.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double nowMs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+int benchWantsPipelineStatistics(ctx* ctx) {
+    if (!ctx->cfg.benchFrames) {
+        return false;
+    }
+
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(ctx->physicalDevice, &supported);
+    if (!supported.pipelineStatisticsQuery) {
+        fprintf(stderr, "WARNING: device has no pipeline statistics queries, "
+                "benchmark will only report timings\n");
+        return false;
+    }
+    if (ctx->cfg.recordThreads && !supported.inheritedQueries) {
+        fprintf(stderr, "WARNING: device can't keep queries active across secondary "
+                "command buffers, benchmark will only report timings\n");
+        return false;
+    }
+    return true;
+}
+
+int createBenchQueries(ctx* ctx) {
+    benchStats* b = &ctx->bench;
+    if (!ctx->cfg.benchFrames) {
+        return true;
+    }
+
+    b->slotPending = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(uint32_t));
+    if (!b->slotPending) {
+        fprintf(stderr, "ERROR: Couldn't allocate benchmark state\n");
+        return false;
+    }
+
+    //decided when the device was created
+    if (b->hasPipelineStatistics) {
+        VkQueryPoolCreateInfo statsInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = ctx->MAX_FRAMES_IN_FLIGHT,
+            .pipelineStatistics = BENCH_STATISTICS,
+        };
+        if (vkCreateQueryPool(ctx->logicalDevice, &statsInfo, NULL,
+                    &b->statsQueryPool) != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't create pipeline statistics query pool\n");
+            return false;
+        }
+    }
+
+    //the timestamps are written on the graphics queue, whose family says how
+    //many bits of them count
+    qfi indices;
+    findQueueFamilies(ctx->physicalDevice, ctx->surface, &indices);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx->physicalDevice, &familyCount, NULL);
+    VkQueueFamilyProperties families[familyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx->physicalDevice, &familyCount, families);
+    uint32_t validBits = families[indices.graphicsFamily].timestampValidBits;
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->physicalDevice, &props);
+    b->timestampPeriod = props.limits.timestampPeriod;
+    b->timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    b->hasTimestamps = validBits != 0;
+    if (!b->hasTimestamps) {
+        fprintf(stderr, "WARNING: graphics queue has no timestamps, benchmark won't "
+                "report gpu time\n");
+    } else {
+        VkQueryPoolCreateInfo timestampInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2 * ctx->MAX_FRAMES_IN_FLIGHT,
+        };
+        if (vkCreateQueryPool(ctx->logicalDevice, &timestampInfo, NULL,
+                    &b->timestampQueryPool) != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't create timestamp query pool\n");
+            return false;
+        }
+    }
+
+    b->lastFrameStart = nowMs();
+    return true;
+}
+
+void benchBeginFrame(ctx* ctx, VkCommandBuffer commandBuffer) {
+    benchStats* b = &ctx->bench;
+    uint32_t slot = ctx->currentFrame;
+    if (!ctx->cfg.benchFrames) {
+        return;
+    }
+
+    if (b->hasPipelineStatistics) {
+        vkCmdResetQueryPool(commandBuffer, b->statsQueryPool, slot, 1);
+        vkCmdBeginQuery(commandBuffer, b->statsQueryPool, slot, 0);
+    }
+    if (b->hasTimestamps) {
+        vkCmdResetQueryPool(commandBuffer, b->timestampQueryPool, 2 * slot, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                b->timestampQueryPool, 2 * slot);
+    }
+}
+
+void benchEndFrame(ctx* ctx, VkCommandBuffer commandBuffer) {
+    benchStats* b = &ctx->bench;
+    uint32_t slot = ctx->currentFrame;
+    if (!ctx->cfg.benchFrames) {
+        return;
+    }
+
+    if (b->hasPipelineStatistics) {
+        vkCmdEndQuery(commandBuffer, b->statsQueryPool, slot);
+    }
+    if (b->hasTimestamps) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                b->timestampQueryPool, 2 * slot + 1);
+    }
+}
+
+void benchSubmitted(ctx* ctx) {
+    if (ctx->cfg.benchFrames) {
+        ctx->bench.slotPending[ctx->currentFrame] = true;
+    }
+}
+
+void benchCollect(ctx* ctx) {
+    benchStats* b = &ctx->bench;
+    uint32_t slot = ctx->currentFrame;
+    if (!ctx->cfg.benchFrames) {
+        return;
+    }
+
+    double now = nowMs();
+    if (!b->slotPending[slot]) {
+        b->lastFrameStart = now;
+        return;
+    }
+    b->slotPending[slot] = false;
+    b->frames++;
+    b->cpuMs += now - b->lastFrameStart;
+    b->lastFrameStart = now;
+
+    //the slot's fence has signalled, so the results are available without a wait
+    if (b->hasPipelineStatistics) {
+        uint64_t stats[2];
+        if (vkGetQueryPoolResults(ctx->logicalDevice, b->statsQueryPool, slot, 1,
+                    sizeof(stats), stats, sizeof(stats), VK_QUERY_RESULT_64_BIT)
+                == VK_SUCCESS) {
+            b->inputVertices += stats[0];
+            b->vertexInvocations += stats[1];
+            if (stats[0] > b->maxInputVertices) {
+                b->maxInputVertices = stats[0];
+            }
+        }
+    }
+    if (b->hasTimestamps) {
+        uint64_t ts[2];
+        if (vkGetQueryPoolResults(ctx->logicalDevice, b->timestampQueryPool, 2 * slot, 2,
+                    sizeof(ts), ts, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT)
+                == VK_SUCCESS) {
+            //only the valid bits count, the difference wraps with them
+            uint64_t ticks = (ts[1] - ts[0]) & b->timestampMask;
+            b->gpuMs += (double) ticks * b->timestampPeriod / 1000000.0;
+        }
+    }
+}
+
+int benchDone(ctx* ctx) {
+    return ctx->cfg.benchFrames && ctx->bench.frames >= ctx->cfg.benchFrames;
+}
+
+int benchReport(ctx* ctx) {
+    benchStats* b = &ctx->bench;
+    if (b->frames == 0) {
+        fprintf(stderr, "ERROR: benchmark finished without any completed frames\n");
+        return false;
+    }
+
+    double frames = (double) b->frames;
+    fprintf(stdout, "bench: %llu frames, %u points\n",
+            (unsigned long long) b->frames, ctx->benchVertices);
+    fprintf(stdout, "bench: cpu frame time %.3f ms\n", b->cpuMs / frames);
+    if (b->hasTimestamps) {
+        fprintf(stdout, "bench: gpu frame time %.3f ms\n", b->gpuMs / frames);
+    }
+    if (!b->hasPipelineStatistics) {
+        return true;
+    }
+
+    fprintf(stdout, "bench: input vertices/frame %.0f, vertex invocations/frame %.0f "
+            "(%.2f per point)\n", b->inputVertices / frames, b->vertexInvocations / frames,
+            b->vertexInvocations / frames / ctx->benchVertices);
+
+    //the input assembler count is exact, unlike vs invocations which an
+    //implementation may legally repeat, so that's what the check uses
+    if (b->maxInputVertices > ctx->benchVertices) {
+        fprintf(stderr, "ERROR: overdraw regression, a frame submitted %llu vertices "
+                "for %u points\n", (unsigned long long) b->maxInputVertices,
+                ctx->benchVertices);
+        return false;
+    }
+    return true;
+}
+
+void destroyBenchQueries(ctx* ctx) {
+    benchStats* b = &ctx->bench;
+    if (b->statsQueryPool) { vkDestroyQueryPool(ctx->logicalDevice, b->statsQueryPool, NULL); }
+    if (b->timestampQueryPool) { vkDestroyQueryPool(ctx->logicalDevice, b->timestampQueryPool, NULL); }
+    if (b->slotPending) { free(b->slotPending); }
+}
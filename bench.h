@@ -0,0 +1,33 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "vulkan.h"
+
+//draw-cost benchmark (--bench-frames N). every frame slot gets a pipeline
+//statistics query around the render pass plus a pair of timestamps, read
+//back once the slot's fence has signalled
+
+//results come back in bit order: input vertices, then vs invocations
+#define BENCH_STATISTICS (VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT \
+        | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT)
+
+//true if the device should be created with pipelineStatisticsQuery, warns
+//when the device can't. called once, the result goes in
+//ctx->bench.hasPipelineStatistics
+int benchWantsPipelineStatistics(ctx* ctx);
+int createBenchQueries(ctx* ctx);
+void benchBeginFrame(ctx* ctx, VkCommandBuffer commandBuffer);
+void benchEndFrame(ctx* ctx, VkCommandBuffer commandBuffer);
+//call once the current slot's frame is submitted. a reused command buffer
+//runs its queries again without being re-recorded
+void benchSubmitted(ctx* ctx);
+
+//call after the current slot's fence wait, before it's re-recorded
+void benchCollect(ctx* ctx);
+int benchDone(ctx* ctx);
+
+//prints the summary, false if the draw submitted more vertices than points
+int benchReport(ctx* ctx);
+void destroyBenchQueries(ctx* ctx);
+
+#endif
@@ -0,0 +1,127 @@
+#include "camera.h"
+#include <math.h>
+#include <stdbool.h>
+
+//per scroll notch
+#define ZOOM_STEP 1.25
+
+void initCamera(ctx* ctx) {
+    cameraState* c = &ctx->camera;
+    c->center[0] = ctx->cfg.center[0];
+    c->center[1] = ctx->cfg.center[1];
+    c->zoom = ctx->cfg.zoom;
+    c->regionOffset[0] = 0.0;
+    c->regionOffset[1] = 0.0;
+    c->regionScale[0] = 1.0;
+    c->regionScale[1] = 1.0;
+    c->dragging = false;
+    c->version++;
+}
+
+//window coordinates to normalized device coordinates, y down like vulkan's
+static void cursorToNdc(GLFWwindow* window, double x, double y, double* ndcX,
+        double* ndcY) {
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    *ndcX = width > 0 ? 2.0 * x / width - 1.0 : 0.0;
+    *ndcY = height > 0 ? 2.0 * y / height - 1.0 : 0.0;
+}
+
+static void scrollCallback(GLFWwindow* window, double dx, double dy) {
+    ctx* ctx = glfwGetWindowUserPointer(window);
+    cameraState* c = &ctx->camera;
+    double x, y, ndcX, ndcY;
+    glfwGetCursorPos(window, &x, &y);
+    cursorToNdc(window, x, y, &ndcX, &ndcY);
+
+    //the world point under the cursor stays under the cursor
+    double zoom = c->zoom * pow(ZOOM_STEP, dy);
+    if (zoom < CAMERA_MIN_ZOOM || zoom > CAMERA_MAX_ZOOM) {
+        return;
+    }
+    c->center[0] += ndcX / c->zoom - ndcX / zoom;
+    c->center[1] += ndcY / c->zoom - ndcY / zoom;
+    c->zoom = zoom;
+    c->version++;
+}
+
+static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    ctx* ctx = glfwGetWindowUserPointer(window);
+    cameraState* c = &ctx->camera;
+    if (button != GLFW_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+    c->dragging = action == GLFW_PRESS;
+    if (c->dragging) {
+        glfwGetCursorPos(window, &c->dragX, &c->dragY);
+    }
+}
+
+static void cursorPosCallback(GLFWwindow* window, double x, double y) {
+    ctx* ctx = glfwGetWindowUserPointer(window);
+    cameraState* c = &ctx->camera;
+    if (!c->dragging) {
+        return;
+    }
+
+    double fromX, fromY, toX, toY;
+    cursorToNdc(window, c->dragX, c->dragY, &fromX, &fromY);
+    cursorToNdc(window, x, y, &toX, &toY);
+    c->center[0] -= (toX - fromX) / c->zoom;
+    c->center[1] -= (toY - fromY) / c->zoom;
+    c->dragX = x;
+    c->dragY = y;
+    c->version++;
+}
+
+static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    ctx* ctx = glfwGetWindowUserPointer(window);
+    if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+        initCamera(ctx);
+    }
+}
+
+void installCameraCallbacks(ctx* ctx) {
+    glfwSetScrollCallback(ctx->window, scrollCallback);
+    glfwSetMouseButtonCallback(ctx->window, mouseButtonCallback);
+    glfwSetCursorPosCallback(ctx->window, cursorPosCallback);
+    glfwSetKeyCallback(ctx->window, keyCallback);
+}
+
+void cameraSetTile(ctx* ctx, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    cameraState* c = &ctx->camera;
+    //the tile's middle in the full view's normalized device coordinates
+    double middleX = (x + ctx->swapchainExtent.width * 0.5) / width * 2.0 - 1.0;
+    double middleY = (y + ctx->swapchainExtent.height * 0.5) / height * 2.0 - 1.0;
+    c->regionOffset[0] = middleX;
+    c->regionOffset[1] = middleY;
+    c->regionScale[0] = (double) width / ctx->swapchainExtent.width;
+    c->regionScale[1] = (double) height / ctx->swapchainExtent.height;
+    c->version++;
+}
+
+//((pos - center) * zoom - offset) * scale, folded into one center and zoom
+vertexParams cameraVertexParams(ctx* ctx) {
+    cameraState* c = &ctx->camera;
+    vertexParams params = {
+        .center = {
+            (float) (c->center[0] + c->regionOffset[0] / c->zoom),
+            (float) (c->center[1] + c->regionOffset[1] / c->zoom),
+        },
+        .zoom = {
+            (float) (c->zoom * c->regionScale[0]),
+            (float) (c->zoom * c->regionScale[1]),
+        },
+        .depth = ctx->cfg.subdivisionDepth,
+    };
+    return params;
+}
+
+vertexParams identityVertexParams(ctx* ctx) {
+    vertexParams params = {
+        .center = { 0.0f, 0.0f },
+        .zoom = { 1.0f, 1.0f },
+        .depth = ctx->cfg.subdivisionDepth,
+    };
+    return params;
+}
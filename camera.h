@@ -0,0 +1,24 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "vulkan.h"
+
+//pan and zoom for every render mode that draws the gasket's own positions
+//(points, subdivision, instanced, lod). the view maps world position p to
+//(p - center) * zoom in normalized device coordinates. with a window:
+//scroll zooms around the cursor, dragging with the left button pans and R
+//goes back to the --center / --zoom view
+
+void initCamera(ctx* ctx);
+void installCameraCallbacks(ctx* ctx);
+
+//draw only the swapchain extent sized tile at pixel x, y of a width x height
+//rendering of the view, see --tiled
+void cameraSetTile(ctx* ctx, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+//the camera as vertex shader push constants, depth is cfg.subdivisionDepth
+vertexParams cameraVertexParams(ctx* ctx);
+//for vertices that are already in view space
+vertexParams identityVertexParams(ctx* ctx);
+
+#endif
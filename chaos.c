@@ -0,0 +1,467 @@
+#include "chaos.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct chaos_isa {
+    const char* name;
+    chaos_kernel kernel;
+    int (*supported)();
+} chaos_isa;
+
+static int always_supported() { return true; }
+#if defined(__x86_64__) || defined(__i386__)
+static int avx2_supported() { return __builtin_cpu_supports("avx2"); }
+static int avx512_supported() { return __builtin_cpu_supports("avx512f"); }
+#endif
+
+//widest first, auto picks the first supported entry
+static const chaos_isa isas[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx512", chaos_kernel_avx512, avx512_supported },
+    { "avx2", chaos_kernel_avx2, avx2_supported },
+    { "sse2", chaos_kernel_sse2, always_supported },
+#endif
+    { "scalar", chaos_kernel_scalar, always_supported },
+};
+static const uint32_t NUM_ISAS = sizeof(isas) / sizeof(isas[0]);
+
+int chaos_select_isa(chaos_engine* engine, const char* isa) {
+    bool any = !isa || strcmp(isa, "auto") == 0;
+    for (uint32_t i = 0; i < NUM_ISAS; i++) {
+        if (!any && strcmp(isa, isas[i].name) != 0) {
+            continue;
+        }
+        if (isas[i].supported()) {
+            engine->kernel = isas[i].kernel;
+            engine->isa = isas[i].name;
+            return true;
+        }
+        if (!any) {
+            fprintf(stderr, "ERROR: cpu doesn't support the %s chaos kernel\n", isa);
+            return false;
+        }
+    }
+
+    fprintf(stderr, "ERROR: unknown chaos kernel %s\n", isa);
+    return false;
+}
+
+uint32_t chaos_default_threads() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t) n : 1;
+}
+
+void chaos_maps_from_ifs(const ifs* system, chaos_maps* out) {
+    memset(out, 0, sizeof(chaos_maps));
+    out->count = system->numMaps;
+    for (uint32_t i = 0; i < system->numMaps; i++) {
+        const ifs_map* m = &system->maps[i];
+        out->a[i] = m->a;
+        out->b[i] = m->b;
+        out->c[i] = m->c;
+        out->d[i] = m->d;
+        out->e[i] = m->e;
+        out->f[i] = m->f;
+        out->red[i] = m->color[0];
+        out->green[i] = m->color[1];
+        out->blue[i] = m->color[2];
+    }
+}
+
+int chaos_init(chaos_engine* engine, const ifs* system, uint64_t seed,
+        uint32_t numThreads, rng_kind rngKind) {
+    memset(engine, 0, sizeof(chaos_engine));
+    engine->seed = seed;
+    engine->system = system;
+    chaos_maps_from_ifs(system, &engine->maps);
+    engine->numThreads = numThreads ? numThreads : chaos_default_threads();
+    engine->walkers = aligned_alloc(_Alignof(chaos_walker),
+            engine->numThreads * sizeof(chaos_walker));
+    if (!engine->walkers) {
+        fprintf(stderr, "ERROR: Couldn't allocate chaos walkers\n");
+        return false;
+    }
+
+    memset(engine->walkers, 0, engine->numThreads * sizeof(chaos_walker));
+    if (!chaos_select_isa(engine, NULL)) {
+        return false;
+    }
+
+    //thread t draws from stream t of the seed
+    uint8_t choices[CHAOS_BLOCK * CHAOS_LANES];
+    for (uint32_t t = 0; t < engine->numThreads; t++) {
+        chaos_walker* w = &engine->walkers[t];
+        rng_seed(&w->rng, rngKind, seed, t);
+        for (uint32_t done = 0; done < system->burnIn; done += CHAOS_BLOCK) {
+            uint32_t steps = system->burnIn - done < CHAOS_BLOCK ? system->burnIn - done
+                : CHAOS_BLOCK;
+            ifs_fill_choices(system, &w->rng, choices, steps * CHAOS_LANES);
+            chaos_kernel_scalar(w, &engine->maps, choices, steps, NULL);
+        }
+    }
+
+    return true;
+}
+
+//exactly one of out, packed and bins is set
+typedef struct chaos_job {
+    chaos_walker* walker;
+    chaos_kernel kernel;
+    const ifs* system;
+    const chaos_maps* maps;
+    Vertex* out;
+    PackedVertex* packed;
+    uint64_t count;
+
+    uint32_t* bins;
+    uint32_t width;
+    uint32_t height;
+    //bins is shared with other threads
+    uint32_t sharedBins;
+} chaos_job;
+
+//SoA -> Vertex, the only place the interleaved layout is touched
+static void interleave(const chaos_soa* soa, Vertex* out, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        out[i].pos[0] = soa->x[i];
+        out[i].pos[1] = soa->y[i];
+        out[i].color[0] = soa->r[i];
+        out[i].color[1] = soa->g[i];
+        out[i].color[2] = soa->b[i];
+    }
+}
+
+static void interleave_packed(const chaos_soa* soa, PackedVertex* out, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = packVertex(soa->x[i], soa->y[i], soa->r[i], soa->g[i], soa->b[i]);
+    }
+}
+
+static inline uint32_t bin_coord(float v, uint32_t size) {
+    int32_t i = (int32_t) ((v + 1.0f) * 0.5f * (float) size);
+    if (i < 0) {
+        return 0;
+    }
+    return (uint32_t) i < size ? (uint32_t) i : size - 1;
+}
+
+static inline uint32_t color_step(float c) {
+    return (uint32_t) (c * CHAOS_HIST_COLOR_STEPS + 0.5f);
+}
+
+//sums are the same in any order, so shared bins stay deterministic
+static void bin_shared(const chaos_soa* soa, const chaos_job* job, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t px = bin_coord(soa->x[i], job->width);
+        uint32_t py = bin_coord(soa->y[i], job->height);
+        _Atomic uint32_t* b = (_Atomic uint32_t*) job->bins
+            + ((size_t) py * job->width + px) * CHAOS_HIST_CHANNELS;
+        atomic_fetch_add_explicit(&b[0], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&b[1], color_step(soa->r[i]), memory_order_relaxed);
+        atomic_fetch_add_explicit(&b[2], color_step(soa->g[i]), memory_order_relaxed);
+        atomic_fetch_add_explicit(&b[3], color_step(soa->b[i]), memory_order_relaxed);
+    }
+}
+
+static void bin(const chaos_soa* soa, const chaos_job* job, uint32_t count) {
+    if (job->sharedBins) {
+        bin_shared(soa, job, count);
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t px = bin_coord(soa->x[i], job->width);
+        uint32_t py = bin_coord(soa->y[i], job->height);
+        uint32_t* b = job->bins + ((size_t) py * job->width + px) * CHAOS_HIST_CHANNELS;
+        b[0]++;
+        b[1] += color_step(soa->r[i]);
+        b[2] += color_step(soa->g[i]);
+        b[3] += color_step(soa->b[i]);
+    }
+}
+
+static void* chaos_worker(void* arg) {
+    chaos_job* job = arg;
+    chaos_walker* w = job->walker;
+
+    //per thread scratch, lives on the worker's own stack
+    chaos_soa soa;
+    uint8_t choices[CHAOS_BLOCK * CHAOS_LANES] __attribute__((aligned(64)));
+
+    //the slice is filled step-major, CHAOS_LANES points per step. a partial
+    //last step still advances every lane so the state stays in lockstep
+    const uint64_t perBlock = CHAOS_BLOCK * CHAOS_LANES;
+    for (uint64_t done = 0; done < job->count; done += perBlock) {
+        uint64_t remaining = job->count - done;
+        uint32_t count = remaining < perBlock ? (uint32_t) remaining : perBlock;
+        uint32_t steps = (count + CHAOS_LANES - 1) / CHAOS_LANES;
+
+        ifs_fill_choices(job->system, &w->rng, choices, steps * CHAOS_LANES);
+        job->kernel(w, job->maps, choices, steps, &soa);
+        if (job->bins) {
+            bin(&soa, job, count);
+        } else if (job->packed) {
+            interleave_packed(&soa, job->packed + done, count);
+        } else {
+            interleave(&soa, job->out + done, count);
+        }
+    }
+
+    return NULL;
+}
+
+struct chaos_thread {
+    pthread_t thread;
+    uint32_t started;
+    uint32_t quit;
+    //set before start is posted
+    chaos_job* job;
+    sem_t start;
+    sem_t done;
+};
+
+static void* chaos_thread_main(void* arg) {
+    struct chaos_thread* t = arg;
+    for (;;) {
+        while (sem_wait(&t->start) != 0 && errno == EINTR) {
+        }
+        if (t->quit) {
+            return NULL;
+        }
+        chaos_worker(t->job);
+        sem_post(&t->done);
+    }
+}
+
+//generating a batch per frame (--progressive) would otherwise pay for
+//creating and joining every thread each time
+static int start_threads(chaos_engine* engine) {
+    if (engine->threads) {
+        return true;
+    }
+    engine->threads = calloc(engine->numThreads, sizeof(struct chaos_thread));
+    if (!engine->threads) {
+        fprintf(stderr, "ERROR: Couldn't allocate chaos threads\n");
+        return false;
+    }
+    for (uint32_t i = 1; i < engine->numThreads; i++) {
+        struct chaos_thread* t = &engine->threads[i];
+        if (sem_init(&t->start, 0, 0) != 0 || sem_init(&t->done, 0, 0) != 0
+                || pthread_create(&t->thread, NULL, chaos_thread_main, t) != 0) {
+            //still deterministic, just slower
+            fprintf(stderr, "WARNING: Couldn't start chaos thread %u, running inline\n", i);
+            continue;
+        }
+        t->started = true;
+    }
+    return true;
+}
+
+//splits numPoints over the engine's threads, job t gets template plus its
+//walker and count. output offsets are filled in for the Vertex cases
+static int run_jobs(chaos_engine* engine, uint64_t numPoints, const chaos_job* template,
+        chaos_job* jobs) {
+    uint32_t n = engine->numThreads;
+    if (!start_threads(engine)) {
+        return false;
+    }
+
+    uint64_t base = numPoints / n;
+    uint64_t extra = numPoints % n;
+    uint64_t offset = 0;
+    for (uint32_t t = 0; t < n; t++) {
+        uint32_t* bins = jobs[t].bins;
+        uint32_t sharedBins = jobs[t].sharedBins;
+        jobs[t] = *template;
+        jobs[t].bins = bins;
+        jobs[t].sharedBins = sharedBins;
+        jobs[t].walker = &engine->walkers[t];
+        jobs[t].kernel = engine->kernel;
+        jobs[t].system = engine->system;
+        jobs[t].maps = &engine->maps;
+        jobs[t].out = template->out ? template->out + offset : NULL;
+        jobs[t].packed = template->packed ? template->packed + offset : NULL;
+        jobs[t].count = base + (t < extra ? 1 : 0);
+        offset += jobs[t].count;
+    }
+
+    //thread 0's slice runs on the calling thread
+    for (uint32_t i = 1; i < n; i++) {
+        struct chaos_thread* t = &engine->threads[i];
+        if (t->started) {
+            t->job = &jobs[i];
+            sem_post(&t->start);
+        } else {
+            chaos_worker(&jobs[i]);
+        }
+    }
+    chaos_worker(&jobs[0]);
+    for (uint32_t i = 1; i < n; i++) {
+        struct chaos_thread* t = &engine->threads[i];
+        if (!t->started) {
+            continue;
+        }
+        while (sem_wait(&t->done) != 0 && errno == EINTR) {
+        }
+    }
+    return true;
+}
+
+int chaos_generate(chaos_engine* engine, uint64_t numPoints, Vertex* out) {
+    chaos_job* jobs = calloc(engine->numThreads, sizeof(chaos_job));
+    if (!jobs) {
+        fprintf(stderr, "ERROR: Couldn't allocate chaos jobs\n");
+        return false;
+    }
+
+    chaos_job template = { .out = out };
+    int ok = run_jobs(engine, numPoints, &template, jobs);
+    free(jobs);
+    return ok;
+}
+
+int chaos_generate_packed(chaos_engine* engine, uint64_t numPoints, PackedVertex* out) {
+    chaos_job* jobs = calloc(engine->numThreads, sizeof(chaos_job));
+    if (!jobs) {
+        fprintf(stderr, "ERROR: Couldn't allocate chaos jobs\n");
+        return false;
+    }
+
+    chaos_job template = { .packed = out };
+    int ok = run_jobs(engine, numPoints, &template, jobs);
+    free(jobs);
+    return ok;
+}
+
+int chaos_histogram(chaos_engine* engine, uint64_t numPoints, uint32_t width,
+        uint32_t height, uint32_t* out) {
+    uint32_t n = engine->numThreads;
+    size_t numBins = (size_t) width * height * CHAOS_HIST_CHANNELS;
+    chaos_job* jobs = calloc(n, sizeof(chaos_job));
+    if (!jobs) {
+        fprintf(stderr, "ERROR: Couldn't allocate chaos jobs\n");
+        return false;
+    }
+
+    //thread 0 bins straight into out, as many others as CHAOS_HIST_BUDGET
+    //allows get private copies. the rest share out with atomic adds
+    size_t copies = CHAOS_HIST_BUDGET / (numBins * sizeof(uint32_t));
+    if (copies > n - 1) {
+        copies = n - 1;
+    }
+    int ok = true;
+    memset(out, 0, numBins * sizeof(uint32_t));
+    jobs[0].bins = out;
+    for (uint32_t t = 1; t <= copies && ok; t++) {
+        jobs[t].bins = calloc(numBins, sizeof(uint32_t));
+        if (!jobs[t].bins) {
+            fprintf(stderr, "ERROR: Couldn't allocate histogram for chaos thread %u\n", t);
+            ok = false;
+        }
+    }
+    jobs[0].sharedBins = copies < n - 1;
+    for (uint32_t t = copies + 1; t < n; t++) {
+        jobs[t].bins = out;
+        jobs[t].sharedBins = true;
+    }
+
+    chaos_job template = { .width = width, .height = height };
+    if (ok) {
+        ok = run_jobs(engine, numPoints, &template, jobs);
+    }
+
+    for (uint32_t t = 1; t <= copies; t++) {
+        if (!jobs[t].bins) {
+            continue;
+        }
+        for (size_t i = 0; ok && i < numBins; i++) {
+            out[i] += jobs[t].bins[i];
+        }
+        free(jobs[t].bins);
+    }
+    free(jobs);
+    return ok;
+}
+
+void chaos_destroy(chaos_engine* engine) {
+    for (uint32_t i = 1; engine->threads && i < engine->numThreads; i++) {
+        struct chaos_thread* t = &engine->threads[i];
+        if (t->started) {
+            t->quit = true;
+            sem_post(&t->start);
+            pthread_join(t->thread, NULL);
+            sem_destroy(&t->start);
+            sem_destroy(&t->done);
+        }
+    }
+    if (engine->threads) { free(engine->threads); }
+    if (engine->walkers) { free(engine->walkers); }
+    memset(engine, 0, sizeof(chaos_engine));
+}
+
+int generate_points(uint64_t numPoints, void* vertices, const config* cfg) {
+    chaos_engine engine;
+    if (!chaos_init(&engine, &cfg->fractal, cfg->seed, cfg->threads, cfg->rng)) {
+        return false;
+    }
+    if (!chaos_select_isa(&engine, cfg->isa)) {
+        chaos_destroy(&engine);
+        return false;
+    }
+    int ok = cfg->packedVertices ? chaos_generate_packed(&engine, numPoints, vertices)
+        : chaos_generate(&engine, numPoints, vertices);
+    chaos_destroy(&engine);
+    return ok;
+}
+
+//points generated per call while exporting, large enough to keep every
+//thread busy, small enough that the set never has to fit in memory
+#define EXPORT_BATCH (1u << 20)
+
+int export_points(const config* cfg) {
+    chaos_engine engine;
+    if (!chaos_init(&engine, &cfg->fractal, cfg->seed, cfg->threads, cfg->rng)) {
+        return false;
+    }
+    Vertex* batch = malloc(EXPORT_BATCH * sizeof(Vertex));
+    if (!batch || !chaos_select_isa(&engine, cfg->isa)) {
+        free(batch);
+        chaos_destroy(&engine);
+        return false;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    point_writer w;
+    int ok = point_writer_open(&w, cfg->exportPoints, cfg->pointLayout, cfg->points,
+            cfg->seed, cfg->rng);
+    if (ok) {
+        for (uint64_t done = 0; ok && done < cfg->points;) {
+            uint64_t n = cfg->points - done < EXPORT_BATCH ? cfg->points - done
+                : EXPORT_BATCH;
+            ok = chaos_generate(&engine, n, batch) && point_writer_append(&w, batch, n);
+            done += n;
+        }
+        ok = point_writer_close(&w) && ok;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (ok) {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        double mb = (POINT_FILE_HEADER_SIZE
+                + (double) cfg->points * point_record_size(cfg->pointLayout)) / 1e6;
+        fprintf(stdout, "exported %u points to %s (%s, %.1f MB) in %.3f s, %.1f MB/s\n",
+                cfg->points, cfg->exportPoints, point_layout_name(cfg->pointLayout), mb,
+                seconds, mb / seconds);
+    }
+    free(batch);
+    chaos_destroy(&engine);
+    return ok;
+}
@@ -0,0 +1,135 @@
+#ifndef CHAOS_H
+#define CHAOS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "ifs.h"
+#include "rng.h"
+#include "vertex.h"
+
+//every thread advances CHAOS_LANES independent lanes in lockstep, one
+//zmm / two ymm / four xmm registers wide. the lane count is fixed so the
+//output doesn't depend on which kernel the cpu ends up dispatching to
+#define CHAOS_LANES 16
+
+//steps per lane generated into the SoA scratch before interleaving
+#define CHAOS_BLOCK 64
+
+//structure-of-arrays state for the CHAOS_LANES lanes owned by one thread.
+//carried across calls so repeated generate calls continue the same sequence
+typedef struct chaos_walker {
+    float x[CHAOS_LANES] __attribute__((aligned(64)));
+    float y[CHAOS_LANES] __attribute__((aligned(64)));
+    float r[CHAOS_LANES] __attribute__((aligned(64)));
+    float g[CHAOS_LANES] __attribute__((aligned(64)));
+    float b[CHAOS_LANES] __attribute__((aligned(64)));
+    rng rng;
+} chaos_walker;
+
+//one block of SoA output, step-major: element [k * CHAOS_LANES + lane]
+typedef struct chaos_soa {
+    float x[CHAOS_BLOCK * CHAOS_LANES] __attribute__((aligned(64)));
+    float y[CHAOS_BLOCK * CHAOS_LANES] __attribute__((aligned(64)));
+    float r[CHAOS_BLOCK * CHAOS_LANES] __attribute__((aligned(64)));
+    float g[CHAOS_BLOCK * CHAOS_LANES] __attribute__((aligned(64)));
+    float b[CHAOS_BLOCK * CHAOS_LANES] __attribute__((aligned(64)));
+} chaos_soa;
+
+//the ifs maps as lookup tables, one column per coefficient. unused entries
+//are zero and never indexed
+typedef struct chaos_maps {
+    float a[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float b[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float c[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float d[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float e[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float f[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float red[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float green[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    float blue[IFS_MAX_MAPS] __attribute__((aligned(64)));
+    uint32_t count;
+} chaos_maps;
+
+void chaos_maps_from_ifs(const ifs* system, chaos_maps* out);
+
+//advance all lanes of w by steps (<= CHAOS_BLOCK) using choices laid out
+//like the SoA output, writing every intermediate position into out (may be NULL).
+//every kernel evaluates x' = (a x + b y) + e, y' = (c x + d y) + f and
+//color' = (color + map color) * 0.5 in that order and without fma, so they
+//all produce the same bits
+typedef void (*chaos_kernel)(chaos_walker* w, const chaos_maps* maps,
+        const uint8_t* choices, uint32_t steps, chaos_soa* out);
+
+void chaos_kernel_scalar(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out);
+#if defined(__x86_64__) || defined(__i386__)
+void chaos_kernel_sse2(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out);
+void chaos_kernel_avx2(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out);
+void chaos_kernel_avx512(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out);
+#endif
+
+struct chaos_thread;
+
+typedef struct chaos_engine {
+    uint64_t seed;
+    uint32_t numThreads;
+    chaos_walker* walkers;
+    //threads 1 to numThreads - 1, started by the first run and reused by
+    //every later one until chaos_destroy. thread 0's share runs on the caller
+    struct chaos_thread* threads;
+    chaos_kernel kernel;
+    const char* isa;
+    const ifs* system;
+    chaos_maps maps;
+} chaos_engine;
+
+uint32_t chaos_default_threads();
+
+//numThreads == 0 picks one thread per online cpu. thread t draws its
+//choices from stream t of seed. system must outlive the engine, every walker
+//runs system->burnIn steps before it emits anything
+int chaos_init(chaos_engine* engine, const ifs* system, uint64_t seed,
+        uint32_t numThreads, rng_kind rngKind);
+
+//force a kernel ("scalar", "sse2", "avx2", "avx512"), NULL or "auto" picks
+//the widest one the cpu supports. fails if the cpu lacks the instructions
+int chaos_select_isa(chaos_engine* engine, const char* isa);
+
+//each thread advances its own lanes and writes a disjoint, contiguous slice
+//of out. output is deterministic for a given seed and thread count
+int chaos_generate(chaos_engine* engine, uint64_t numPoints, Vertex* out);
+//same points, written as PackedVertex
+int chaos_generate_packed(chaos_engine* engine, uint64_t numPoints, PackedVertex* out);
+void chaos_destroy(chaos_engine* engine);
+
+//uint32 bins per pixel of a density histogram: hits, then the red, green and
+//blue sums in 1/CHAOS_HIST_COLOR_STEPS steps. the steps are coarse so that
+//the sums of CHAOS_HIST_MAX_POINTS hits, all on one pixel, still fit. the
+//average over a pixel's hits hides most of the banding. chaos.comp.glsl
+//and tonemap.frag.glsl have their own copy of the step count
+#define CHAOS_HIST_CHANNELS 4
+#define CHAOS_HIST_COLOR_STEPS 15
+#define CHAOS_HIST_MAX_POINTS (UINT32_MAX / CHAOS_HIST_COLOR_STEPS)
+
+//bins numPoints points over a width x height grid covering [-1,1]^2 the
+//same way the rasterizer maps them, rows top to bottom. out holds
+//width * height * CHAOS_HIST_CHANNELS counters and is overwritten. threads
+//bin into private copies that are summed at the end, as many as fit in
+//CHAOS_HIST_BUDGET bytes. threads past that share out with atomic adds, so
+//memory stays bounded at high resolutions and thread counts
+#define CHAOS_HIST_BUDGET ((size_t) 256 << 20)
+int chaos_histogram(chaos_engine* engine, uint64_t numPoints, uint32_t width,
+        uint32_t height, uint32_t* out);
+
+//one-shot helper: seed, thread count, rng and kernel come from cfg. vertices
+//holds Vertex, or PackedVertex with cfg->packedVertices
+int generate_points(uint64_t numPoints, void* vertices, const config* cfg);
+
+//streams cfg->points points into cfg->exportPoints a batch at a time, see
+//pointfile.h for the format
+int export_points(const config* cfg);
+
+#endif
@@ -0,0 +1,238 @@
+#include "chaos.h"
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+void chaos_kernel_scalar(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out) {
+    for (uint32_t k = 0; k < steps; k++) {
+        for (uint32_t l = 0; l < CHAOS_LANES; l++) {
+            uint32_t j = choices[k * CHAOS_LANES + l];
+            float x = w->x[l], y = w->y[l];
+            w->x[l] = (maps->a[j] * x + maps->b[j] * y) + maps->e[j];
+            w->y[l] = (maps->c[j] * x + maps->d[j] * y) + maps->f[j];
+            w->r[l] = (w->r[l] + maps->red[j]) * 0.5f;
+            w->g[l] = (w->g[l] + maps->green[j]) * 0.5f;
+            w->b[l] = (w->b[l] + maps->blue[j]) * 0.5f;
+        }
+        if (out) {
+            for (uint32_t l = 0; l < CHAOS_LANES; l++) {
+                out->x[k * CHAOS_LANES + l] = w->x[l];
+                out->y[k * CHAOS_LANES + l] = w->y[l];
+                out->r[k * CHAOS_LANES + l] = w->r[l];
+                out->g[k * CHAOS_LANES + l] = w->g[l];
+                out->b[k * CHAOS_LANES + l] = w->b[l];
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+//sse2 has no variable permute, so every column is looked up with one
+//compare mask per map. exactly one mask is set per lane, or-ing the masked
+//entries picks it
+typedef struct lookup_sse2 {
+    __m128 a, b, c, d, e, f, red, green, blue;
+} lookup_sse2;
+
+static inline void lookup_maps_sse2(const chaos_maps* maps, __m128i idx, lookup_sse2* t) {
+    __m128 zero = _mm_setzero_ps();
+    *t = (lookup_sse2) { zero, zero, zero, zero, zero, zero, zero, zero, zero };
+    for (uint32_t j = 0; j < maps->count; j++) {
+        __m128 m = _mm_castsi128_ps(_mm_cmpeq_epi32(idx, _mm_set1_epi32(j)));
+        t->a = _mm_or_ps(t->a, _mm_and_ps(m, _mm_set1_ps(maps->a[j])));
+        t->b = _mm_or_ps(t->b, _mm_and_ps(m, _mm_set1_ps(maps->b[j])));
+        t->c = _mm_or_ps(t->c, _mm_and_ps(m, _mm_set1_ps(maps->c[j])));
+        t->d = _mm_or_ps(t->d, _mm_and_ps(m, _mm_set1_ps(maps->d[j])));
+        t->e = _mm_or_ps(t->e, _mm_and_ps(m, _mm_set1_ps(maps->e[j])));
+        t->f = _mm_or_ps(t->f, _mm_and_ps(m, _mm_set1_ps(maps->f[j])));
+        t->red = _mm_or_ps(t->red, _mm_and_ps(m, _mm_set1_ps(maps->red[j])));
+        t->green = _mm_or_ps(t->green, _mm_and_ps(m, _mm_set1_ps(maps->green[j])));
+        t->blue = _mm_or_ps(t->blue, _mm_and_ps(m, _mm_set1_ps(maps->blue[j])));
+    }
+}
+
+void chaos_kernel_sse2(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (uint32_t v = 0; v < CHAOS_LANES; v += 4) {
+        __m128 x = _mm_load_ps(w->x + v);
+        __m128 y = _mm_load_ps(w->y + v);
+        __m128 r = _mm_load_ps(w->r + v);
+        __m128 g = _mm_load_ps(w->g + v);
+        __m128 b = _mm_load_ps(w->b + v);
+
+        for (uint32_t k = 0; k < steps; k++) {
+            int32_t packed;
+            __builtin_memcpy(&packed, choices + k * CHAOS_LANES + v, sizeof(packed));
+            __m128i idx = _mm_unpacklo_epi16(
+                    _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+            lookup_sse2 t;
+            lookup_maps_sse2(maps, idx, &t);
+
+            __m128 nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t.a, x), _mm_mul_ps(t.b, y)), t.e);
+            y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t.c, x), _mm_mul_ps(t.d, y)), t.f);
+            x = nx;
+            r = _mm_mul_ps(_mm_add_ps(r, t.red), half);
+            g = _mm_mul_ps(_mm_add_ps(g, t.green), half);
+            b = _mm_mul_ps(_mm_add_ps(b, t.blue), half);
+
+            if (out) {
+                size_t o = k * CHAOS_LANES + v;
+                _mm_store_ps(out->x + o, x);
+                _mm_store_ps(out->y + o, y);
+                _mm_store_ps(out->r + o, r);
+                _mm_store_ps(out->g + o, g);
+                _mm_store_ps(out->b + o, b);
+            }
+        }
+
+        _mm_store_ps(w->x + v, x);
+        _mm_store_ps(w->y + v, y);
+        _mm_store_ps(w->r + v, r);
+        _mm_store_ps(w->g + v, g);
+        _mm_store_ps(w->b + v, b);
+    }
+}
+
+//a 16 entry column in two ymm registers. permutevar8x32 only reads idx & 7,
+//bit 3 of idx moved into the sign bit picks the half
+typedef struct column_avx2 {
+    __m256 lo, hi;
+} column_avx2;
+
+__attribute__((target("avx2")))
+static inline column_avx2 load_column_avx2(const float* column) {
+    return (column_avx2) { _mm256_load_ps(column), _mm256_load_ps(column + 8) };
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lookup_avx2(column_avx2 t, __m256i idx, __m256 upper) {
+    return _mm256_blendv_ps(_mm256_permutevar8x32_ps(t.lo, idx),
+            _mm256_permutevar8x32_ps(t.hi, idx), upper);
+}
+
+__attribute__((target("avx2")))
+static inline void step_avx2(const column_avx2* t, __m256i idx, __m256* x, __m256* y,
+        __m256* r, __m256* g, __m256* b) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 upper = _mm256_castsi256_ps(_mm256_slli_epi32(idx, 28));
+    __m256 nx = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(lookup_avx2(t[0], idx, upper), *x),
+                _mm256_mul_ps(lookup_avx2(t[1], idx, upper), *y)),
+            lookup_avx2(t[4], idx, upper));
+    *y = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(lookup_avx2(t[2], idx, upper), *x),
+                _mm256_mul_ps(lookup_avx2(t[3], idx, upper), *y)),
+            lookup_avx2(t[5], idx, upper));
+    *x = nx;
+    *r = _mm256_mul_ps(_mm256_add_ps(*r, lookup_avx2(t[6], idx, upper)), half);
+    *g = _mm256_mul_ps(_mm256_add_ps(*g, lookup_avx2(t[7], idx, upper)), half);
+    *b = _mm256_mul_ps(_mm256_add_ps(*b, lookup_avx2(t[8], idx, upper)), half);
+}
+
+__attribute__((target("avx2")))
+void chaos_kernel_avx2(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out) {
+    //a, b, c, d, e, f, red, green, blue
+    const column_avx2 t[9] = {
+        load_column_avx2(maps->a), load_column_avx2(maps->b),
+        load_column_avx2(maps->c), load_column_avx2(maps->d),
+        load_column_avx2(maps->e), load_column_avx2(maps->f),
+        load_column_avx2(maps->red), load_column_avx2(maps->green),
+        load_column_avx2(maps->blue),
+    };
+
+    //both 8-lane halves in flight at once to hide the mul->add latency
+    __m256 x0 = _mm256_load_ps(w->x), x1 = _mm256_load_ps(w->x + 8);
+    __m256 y0 = _mm256_load_ps(w->y), y1 = _mm256_load_ps(w->y + 8);
+    __m256 r0 = _mm256_load_ps(w->r), r1 = _mm256_load_ps(w->r + 8);
+    __m256 g0 = _mm256_load_ps(w->g), g1 = _mm256_load_ps(w->g + 8);
+    __m256 b0 = _mm256_load_ps(w->b), b1 = _mm256_load_ps(w->b + 8);
+
+    for (uint32_t k = 0; k < steps; k++) {
+        const uint8_t* c = choices + k * CHAOS_LANES;
+        __m256i i0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) c));
+        __m256i i1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (c + 8)));
+
+        step_avx2(t, i0, &x0, &y0, &r0, &g0, &b0);
+        step_avx2(t, i1, &x1, &y1, &r1, &g1, &b1);
+
+        if (out) {
+            size_t o = k * CHAOS_LANES;
+            _mm256_store_ps(out->x + o, x0); _mm256_store_ps(out->x + o + 8, x1);
+            _mm256_store_ps(out->y + o, y0); _mm256_store_ps(out->y + o + 8, y1);
+            _mm256_store_ps(out->r + o, r0); _mm256_store_ps(out->r + o + 8, r1);
+            _mm256_store_ps(out->g + o, g0); _mm256_store_ps(out->g + o + 8, g1);
+            _mm256_store_ps(out->b + o, b0); _mm256_store_ps(out->b + o + 8, b1);
+        }
+    }
+
+    _mm256_store_ps(w->x, x0); _mm256_store_ps(w->x + 8, x1);
+    _mm256_store_ps(w->y, y0); _mm256_store_ps(w->y + 8, y1);
+    _mm256_store_ps(w->r, r0); _mm256_store_ps(w->r + 8, r1);
+    _mm256_store_ps(w->g, g0); _mm256_store_ps(w->g + 8, g1);
+    _mm256_store_ps(w->b, b0); _mm256_store_ps(w->b + 8, b1);
+}
+
+//a whole 16 entry column fits one zmm register
+__attribute__((target("avx512f")))
+void chaos_kernel_avx512(chaos_walker* w, const chaos_maps* maps, const uint8_t* choices,
+        uint32_t steps, chaos_soa* out) {
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 ta = _mm512_load_ps(maps->a);
+    const __m512 tb = _mm512_load_ps(maps->b);
+    const __m512 tc = _mm512_load_ps(maps->c);
+    const __m512 td = _mm512_load_ps(maps->d);
+    const __m512 te = _mm512_load_ps(maps->e);
+    const __m512 tf = _mm512_load_ps(maps->f);
+    const __m512 tred = _mm512_load_ps(maps->red);
+    const __m512 tgreen = _mm512_load_ps(maps->green);
+    const __m512 tblue = _mm512_load_ps(maps->blue);
+
+    __m512 x = _mm512_load_ps(w->x);
+    __m512 y = _mm512_load_ps(w->y);
+    __m512 r = _mm512_load_ps(w->r);
+    __m512 g = _mm512_load_ps(w->g);
+    __m512 b = _mm512_load_ps(w->b);
+
+    for (uint32_t k = 0; k < steps; k++) {
+        __m512i idx = _mm512_cvtepu8_epi32(
+                _mm_loadu_si128((const __m128i*) (choices + k * CHAOS_LANES)));
+
+        __m512 nx = _mm512_add_ps(_mm512_add_ps(
+                    _mm512_mul_ps(_mm512_permutexvar_ps(idx, ta), x),
+                    _mm512_mul_ps(_mm512_permutexvar_ps(idx, tb), y)),
+                _mm512_permutexvar_ps(idx, te));
+        y = _mm512_add_ps(_mm512_add_ps(
+                    _mm512_mul_ps(_mm512_permutexvar_ps(idx, tc), x),
+                    _mm512_mul_ps(_mm512_permutexvar_ps(idx, td), y)),
+                _mm512_permutexvar_ps(idx, tf));
+        x = nx;
+        r = _mm512_mul_ps(_mm512_add_ps(r, _mm512_permutexvar_ps(idx, tred)), half);
+        g = _mm512_mul_ps(_mm512_add_ps(g, _mm512_permutexvar_ps(idx, tgreen)), half);
+        b = _mm512_mul_ps(_mm512_add_ps(b, _mm512_permutexvar_ps(idx, tblue)), half);
+
+        if (out) {
+            size_t o = k * CHAOS_LANES;
+            _mm512_store_ps(out->x + o, x);
+            _mm512_store_ps(out->y + o, y);
+            _mm512_store_ps(out->r + o, r);
+            _mm512_store_ps(out->g + o, g);
+            _mm512_store_ps(out->b + o, b);
+        }
+    }
+
+    _mm512_store_ps(w->x, x);
+    _mm512_store_ps(w->y, y);
+    _mm512_store_ps(w->r, r);
+    _mm512_store_ps(w->g, g);
+    _mm512_store_ps(w->b, b);
+}
+
+#endif
@@ -0,0 +1,476 @@
+#include "config.h"
+#include "chaos.h"
+#include "subdivision.h"
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+void print_usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --config FILE            read key = value options from FILE first\n"
+            "  --points N               number of points to generate (default: 10000)\n"
+            "  --width N                window width (default: 800)\n"
+            "  --height N               window height (default: 600)\n"
+            "  --frames-in-flight N     frames the cpu may queue ahead, 1-16 (default: 2)\n"
+            "  --progressive N          add N new points per frame until --points have\n"
+            "                           been drawn, accumulating them. moving the view\n"
+            "                           starts over (default: 0, off)\n"
+            "  --render MODE            points | histogram | subdivision | instanced |\n"
+            "                           lod. histogram bins the points and tonemaps the\n"
+            "                           log density, subdivision draws the gasket's\n"
+            "                           triangles from an index buffer, instanced as\n"
+            "                           instances of one triangle, lod only the visible\n"
+            "                           triangles down to --lod-pixels (default: points)\n"
+            "  --depth N                subdivision depth, 3^N triangles, up to 15, or\n"
+            "                           19 when instanced (default: 8)\n"
+            "  --lod-pixels F           lod stops subdividing triangles this many pixels\n"
+            "                           across, 0.25-64 (default: 2)\n"
+            "  --center X,Y             point at the middle of the view (default: 0,0)\n"
+            "  --zoom F                 magnification, scroll and drag to change it\n"
+            "                           (default: 1)\n"
+            "  --gamma F                histogram tonemapping gamma (default: 2.2)\n"
+            "  --seed N                 seed for point generation (default: time based)\n"
+            "  --rng KIND               xoshiro | pcg | philox (default: xoshiro)\n"
+            "  --threads N              generator threads, 0 = one per cpu (default: 0)\n"
+            "  --isa NAME               auto | avx512 | avx2 | sse2 | scalar (default: auto)\n"
+            "  --generator WHERE        cpu | gpu, gpu runs a compute shader (default: cpu)\n"
+            "  --fractal NAME|FILE      gasket | carpet | vicsek | fern, or a file of\n"
+            "                           affine maps, one 'a b c d e f weight [r g b]'\n"
+            "                           per line (default: gasket)\n"
+            "  --vertex-format F        full | packed, packed is 8 bytes per point instead\n"
+            "                           of 20 (default: full)\n"
+            "  --export-points FILE     write --points points to FILE and exit\n"
+            "  --point-layout L         f32 | f16 | u16 export precision (default: f32)\n"
+            "  --load-points FILE       draw the points from an exported FILE\n"
+            "  --resident-points N      keep at most N of the FILE's points on the gpu\n"
+            "                           and stream chunks in as the view needs them, for\n"
+            "                           files larger than gpu memory (default: 0, all)\n"
+            "  --bench-frames N         render N frames, report draw cost and exit\n"
+            "  --headless FILE          no window, render --width x --height offscreen\n"
+            "                           and write to FILE (.png, .ppm or .raw rgba)\n"
+            "  --headless-frames N      frames to render and write, numbered when more\n"
+            "                           than one: out.png -> out_000042.png (default: 1)\n"
+            "  --encoders N             threads encoding headless frames (default: 2)\n"
+            "  --tiled WxH              write one W x H --headless image (.ppm or .raw)\n"
+            "                           rendered in tiles, up to 1048576 per side\n"
+            "  --tile-size N            largest tile side, lowered to the device's\n"
+            "                           limit, 64-16384 (default: 4096)\n"
+            "  --pipeline-cache FILE    load compiled pipelines from FILE and save them\n"
+            "                           back, none to skip (default:\n"
+            "                           $XDG_CACHE_HOME/gasket/pipeline_cache.bin)\n"
+            "  --record WHEN            cached | always, cached re-records a frame's\n"
+            "                           command buffer only when the view changes\n"
+            "                           (default: cached)\n"
+            "  --record-threads N       record the draws on N threads into secondary\n"
+            "                           command buffers, 0-64 (default: 0, inline)\n"
+            "  --help                   show this message\n",
+            prog);
+}
+
+static int parse_u64(const char* opt, const char* s, uint64_t* out) {
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 0);
+    if (errno || end == s || *end != '\0' || s[0] == '-') {
+        fprintf(stderr, "ERROR: %s expects an unsigned integer, got '%s'\n", opt, s);
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static int parse_u32_range(const char* opt, const char* s, uint32_t min, uint32_t max,
+        uint32_t* out) {
+    uint64_t v;
+    if (!parse_u64(opt, s, &v)) {
+        return false;
+    }
+    if (v < min || v > max) {
+        fprintf(stderr, "ERROR: %s must be between %u and %u, got %s\n", opt, min, max, s);
+        return false;
+    }
+    *out = (uint32_t) v;
+    return true;
+}
+
+static int parse_float_range(const char* opt, const char* s, float min, float max,
+        float* out) {
+    char* end;
+    errno = 0;
+    float v = strtof(s, &end);
+    if (errno || end == s || *end != '\0' || !(v >= min && v <= max)) {
+        fprintf(stderr, "ERROR: %s expects a number between %g and %g, got '%s'\n",
+                opt, min, max, s);
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+//config owns its strings, a repeated option replaces the earlier copy
+static int set_string(const char** field, const char* val) {
+    char* copy = strdup(val);
+    if (!copy) {
+        fprintf(stderr, "ERROR: Couldn't allocate option value\n");
+        return false;
+    }
+    free((char*) *field);
+    *field = copy;
+    return true;
+}
+
+static int apply_option(config* cfg, const char* key, const char* val) {
+    if (strcmp(key, "seed") == 0) {
+        return parse_u64(key, val, &cfg->seed);
+    } else if (strcmp(key, "rng") == 0) {
+        if (!rng_parse_kind(val, &cfg->rng)) {
+            fprintf(stderr, "ERROR: unknown rng '%s'\n", val);
+            return false;
+        }
+        return true;
+    } else if (strcmp(key, "threads") == 0) {
+        return parse_u32_range(key, val, 0, 4096, &cfg->threads);
+    } else if (strcmp(key, "isa") == 0) {
+        return set_string(&cfg->isa, val);
+    } else if (strcmp(key, "fractal") == 0) {
+        //an existing file wins over a preset of the same name
+        return access(val, R_OK) == 0 ? ifs_load(val, &cfg->fractal)
+            : ifs_preset(val, &cfg->fractal);
+    } else if (strcmp(key, "headless") == 0) {
+        if (!image_format_from_path(val, &cfg->headlessFormat)) {
+            fprintf(stderr, "ERROR: headless output must end in .png, .ppm or .raw, "
+                    "got '%s'\n", val);
+            return false;
+        }
+        return set_string(&cfg->headlessOutput, val);
+    } else if (strcmp(key, "vertex-format") == 0) {
+        if (strcmp(val, "full") != 0 && strcmp(val, "packed") != 0) {
+            fprintf(stderr, "ERROR: vertex format must be full or packed, got '%s'\n", val);
+            return false;
+        }
+        cfg->packedVertices = strcmp(val, "packed") == 0;
+        return true;
+    } else if (strcmp(key, "export-points") == 0) {
+        return set_string(&cfg->exportPoints, val);
+    } else if (strcmp(key, "point-layout") == 0) {
+        if (!point_layout_from_name(val, &cfg->pointLayout)) {
+            fprintf(stderr, "ERROR: point layout must be f32, f16 or u16, got '%s'\n", val);
+            return false;
+        }
+        return true;
+    } else if (strcmp(key, "load-points") == 0) {
+        return set_string(&cfg->loadPoints, val);
+    } else if (strcmp(key, "resident-points") == 0) {
+        //slots are addressed with a uint32_t first vertex
+        return parse_u32_range(key, val, 0, UINT32_MAX, &cfg->residentPoints);
+    } else if (strcmp(key, "tiled") == 0) {
+        char* end;
+        errno = 0;
+        unsigned long width = strtoul(val, &end, 10);
+        const char* h = end + 1;
+        if (errno || end == val || *end != 'x' || val[0] == '-' || h[0] == '-') {
+            fprintf(stderr, "ERROR: tiled expects WxH, got '%s'\n", val);
+            return false;
+        }
+        unsigned long height = strtoul(h, &end, 10);
+        if (errno || end == h || *end != '\0' || width < 1 || width > TILED_MAX_SIZE
+                || height < 1 || height > TILED_MAX_SIZE) {
+            fprintf(stderr, "ERROR: tiled expects WxH of 1 to %u each, got '%s'\n",
+                    TILED_MAX_SIZE, val);
+            return false;
+        }
+        cfg->tiledWidth = (uint32_t) width;
+        cfg->tiledHeight = (uint32_t) height;
+        return true;
+    } else if (strcmp(key, "pipeline-cache") == 0) {
+        if (strcmp(val, "none") == 0) {
+            free((char*) cfg->pipelineCachePath);
+            cfg->pipelineCachePath = NULL;
+            return true;
+        }
+        return set_string(&cfg->pipelineCachePath, val);
+    } else if (strcmp(key, "record") == 0) {
+        if (strcmp(val, "cached") != 0 && strcmp(val, "always") != 0) {
+            fprintf(stderr, "ERROR: record must be cached or always, got '%s'\n", val);
+            return false;
+        }
+        cfg->recordEveryFrame = strcmp(val, "always") == 0;
+        return true;
+    } else if (strcmp(key, "record-threads") == 0) {
+        return parse_u32_range(key, val, 0, 64, &cfg->recordThreads);
+    } else if (strcmp(key, "tile-size") == 0) {
+        return parse_u32_range(key, val, 64, 16384, &cfg->tileSize);
+    } else if (strcmp(key, "headless-frames") == 0) {
+        return parse_u32_range(key, val, 1, 1000000, &cfg->headlessFrames);
+    } else if (strcmp(key, "encoders") == 0) {
+        return parse_u32_range(key, val, 1, 64, &cfg->encoders);
+    } else if (strcmp(key, "generator") == 0) {
+        if (strcmp(val, "cpu") != 0 && strcmp(val, "gpu") != 0) {
+            fprintf(stderr, "ERROR: generator must be cpu or gpu, got '%s'\n", val);
+            return false;
+        }
+        cfg->gpuGenerate = strcmp(val, "gpu") == 0;
+        return true;
+    } else if (strcmp(key, "points") == 0) {
+        //the draw count is a uint32_t
+        return parse_u32_range(key, val, 1, UINT32_MAX, &cfg->points);
+    } else if (strcmp(key, "width") == 0) {
+        return parse_u32_range(key, val, 1, 16384, &cfg->width);
+    } else if (strcmp(key, "height") == 0) {
+        return parse_u32_range(key, val, 1, 16384, &cfg->height);
+    } else if (strcmp(key, "frames-in-flight") == 0) {
+        return parse_u32_range(key, val, 1, 16, &cfg->framesInFlight);
+    } else if (strcmp(key, "progressive") == 0) {
+        return parse_u32_range(key, val, 0, UINT32_MAX, &cfg->pointsPerFrame);
+    } else if (strcmp(key, "render") == 0) {
+        if (strcmp(val, "points") != 0 && strcmp(val, "histogram") != 0
+                && strcmp(val, "subdivision") != 0 && strcmp(val, "instanced") != 0
+                && strcmp(val, "lod") != 0) {
+            fprintf(stderr, "ERROR: render must be points, histogram, subdivision, "
+                    "instanced or lod, got '%s'\n", val);
+            return false;
+        }
+        cfg->histogram = strcmp(val, "histogram") == 0;
+        cfg->subdivision = strcmp(val, "subdivision") == 0;
+        cfg->instanced = strcmp(val, "instanced") == 0;
+        cfg->lod = strcmp(val, "lod") == 0;
+        return true;
+    } else if (strcmp(key, "lod-pixels") == 0) {
+        return parse_float_range(key, val, 0.25f, 64.0f, &cfg->lodPixels);
+    } else if (strcmp(key, "center") == 0) {
+        char* end;
+        errno = 0;
+        cfg->center[0] = strtod(val, &end);
+        if (errno || end == val || *end != ',' || !isfinite(cfg->center[0])) {
+            fprintf(stderr, "ERROR: center expects X,Y, got '%s'\n", val);
+            return false;
+        }
+        const char* y = end + 1;
+        cfg->center[1] = strtod(y, &end);
+        if (errno || end == y || *end != '\0' || !isfinite(cfg->center[1])) {
+            fprintf(stderr, "ERROR: center expects X,Y, got '%s'\n", val);
+            return false;
+        }
+        return true;
+    } else if (strcmp(key, "zoom") == 0) {
+        char* end;
+        errno = 0;
+        cfg->zoom = strtod(val, &end);
+        if (errno || end == val || *end != '\0'
+                || !(cfg->zoom >= CAMERA_MIN_ZOOM && cfg->zoom <= CAMERA_MAX_ZOOM)) {
+            fprintf(stderr, "ERROR: zoom expects a number between %g and %g, got '%s'\n",
+                    CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM, val);
+            return false;
+        }
+        return true;
+    } else if (strcmp(key, "depth") == 0) {
+        return parse_u32_range(key, val, 0, INSTANCED_MAX_DEPTH, &cfg->subdivisionDepth);
+    } else if (strcmp(key, "gamma") == 0) {
+        return parse_float_range(key, val, 0.1f, 10.0f, &cfg->gamma);
+    } else if (strcmp(key, "bench-frames") == 0) {
+        return parse_u32_range(key, val, 0, UINT32_MAX, &cfg->benchFrames);
+    }
+
+    fprintf(stderr, "ERROR: unknown option %s\n", key);
+    return false;
+}
+
+static char* trim(char* s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return s;
+}
+
+int load_config_file(const char* path, config* cfg) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: Couldn't open config file %s\n", path);
+        return false;
+    }
+
+    char line[512];
+    uint32_t lineNumber = 0;
+    int ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char* key = trim(line);
+        if (*key == '\0' || *key == '#') {
+            continue;
+        }
+
+        char* eq = strchr(key, '=');
+        if (!eq) {
+            fprintf(stderr, "ERROR: %s:%u: expected key = value\n", path, lineNumber);
+            ok = false;
+            break;
+        }
+        *eq = '\0';
+        key = trim(key);
+        char* val = trim(eq + 1);
+        if (!apply_option(cfg, key, val)) {
+            fprintf(stderr, "ERROR: %s:%u: bad option\n", path, lineNumber);
+            ok = false;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+//$XDG_CACHE_HOME or ~/.cache, NULL without either
+static char* default_pipeline_cache_path() {
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* suffix = "/gasket/pipeline_cache.bin";
+    if (!base || base[0] != '/') {
+        base = getenv("HOME");
+        suffix = "/.cache/gasket/pipeline_cache.bin";
+    }
+    if (!base || !base[0]) {
+        return NULL;
+    }
+    size_t size = strlen(base) + strlen(suffix) + 1;
+    char* path = malloc(size);
+    if (path) {
+        snprintf(path, size, "%s%s", base, suffix);
+    }
+    return path;
+}
+
+int parse_args(int argc, char** argv, config* cfg) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    memset(cfg, 0, sizeof(config));
+    cfg->seed = (uint64_t) now.tv_sec * 1000000007ull ^ (uint64_t) now.tv_nsec
+        ^ ((uint64_t) getpid() << 32);
+    cfg->rng = RNG_XOSHIRO256SS;
+    cfg->threads = 0;
+    if (!set_string(&cfg->isa, "auto")) {
+        return false;
+    }
+    cfg->points = 10000;
+    cfg->width = 800;
+    cfg->height = 600;
+    cfg->framesInFlight = 2;
+    cfg->gamma = 2.2f;
+    cfg->subdivisionDepth = 8;
+    cfg->lodPixels = 2.0f;
+    cfg->zoom = 1.0;
+    cfg->headlessFrames = 1;
+    cfg->encoders = 2;
+    cfg->tileSize = 4096;
+    cfg->pipelineCachePath = default_pipeline_cache_path();
+    if (!ifs_preset("gasket", &cfg->fractal)) {
+        return false;
+    }
+
+    //config file first so that explicit flags override it. options are
+    //walked like below, so another option's value is never taken for --config
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            continue;
+        }
+        if (strcmp(argv[i], "--config") == 0 && !load_config_file(argv[i + 1], cfg)) {
+            return false;
+        }
+        i++;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "--help") == 0 || strcmp(opt, "-h") == 0) {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (strncmp(opt, "--", 2) != 0 || i + 1 >= argc) {
+            fprintf(stderr, "ERROR: unknown option or missing value: %s\n", opt);
+            print_usage(argv[0]);
+            return false;
+        }
+        const char* val = argv[++i];
+        if (strcmp(opt, "--config") == 0) {
+            continue;
+        }
+
+        if (!apply_option(cfg, opt + 2, val)) {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (cfg->histogram && cfg->pointsPerFrame) {
+        fprintf(stderr, "ERROR: --render histogram can't be combined with --progressive\n");
+        return false;
+    }
+    //past that the color sums of a pixel could wrap
+    if (cfg->histogram && cfg->points > CHAOS_HIST_MAX_POINTS) {
+        fprintf(stderr, "ERROR: --render histogram bins at most %u points\n",
+                (uint32_t) CHAOS_HIST_MAX_POINTS);
+        return false;
+    }
+    if (cfg->loadPoints && (cfg->gpuGenerate || cfg->pointsPerFrame || cfg->histogram)) {
+        fprintf(stderr, "ERROR: --load-points only works with the cpu generator, "
+                "--render points and without --progressive\n");
+        return false;
+    }
+    if (cfg->residentPoints && !cfg->loadPoints) {
+        fprintf(stderr, "ERROR: --resident-points streams a --load-points file\n");
+        return false;
+    }
+    if ((cfg->subdivision || cfg->instanced || cfg->lod) && (cfg->gpuGenerate
+                || cfg->pointsPerFrame || cfg->loadPoints
+                || strcmp(cfg->fractal.name, "gasket") != 0)) {
+        fprintf(stderr, "ERROR: --render subdivision, instanced and lod draw the gasket "
+                "itself, they can't be combined with --generator gpu, --progressive, "
+                "--load-points or --fractal\n");
+        return false;
+    }
+    if (cfg->subdivision && cfg->subdivisionDepth > SUBDIV_MAX_DEPTH) {
+        fprintf(stderr, "ERROR: --render subdivision goes up to --depth %u\n",
+                SUBDIV_MAX_DEPTH);
+        return false;
+    }
+    if (cfg->recordThreads && (cfg->histogram || cfg->pointsPerFrame)) {
+        fprintf(stderr, "ERROR: --record-threads records the point set pass, not "
+                "--render histogram or --progressive\n");
+        return false;
+    }
+    if (cfg->headlessOutput && cfg->pointsPerFrame) {
+        fprintf(stderr, "ERROR: --headless can't be combined with --progressive\n");
+        return false;
+    }
+    if (cfg->tiledWidth && (!cfg->headlessOutput || cfg->headlessFormat == IMAGE_PNG
+                || cfg->headlessFrames > 1 || cfg->benchFrames)) {
+        fprintf(stderr, "ERROR: --tiled needs --headless with a .ppm or .raw file and "
+                "writes a single image, without --headless-frames or --bench-frames\n");
+        return false;
+    }
+    if (cfg->tiledWidth && (cfg->histogram || cfg->lod)) {
+        fprintf(stderr, "ERROR: --tiled can't be combined with --render histogram or lod\n");
+        return false;
+    }
+    return true;
+}
+
+void free_config(config* cfg) {
+    free((char*) cfg->isa);
+    free((char*) cfg->exportPoints);
+    free((char*) cfg->loadPoints);
+    free((char*) cfg->headlessOutput);
+    free((char*) cfg->pipelineCachePath);
+    memset(cfg, 0, sizeof(config));
+}
@@ -0,0 +1,105 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include "ifs.h"
+#include "image_io.h"
+#include "pointfile.h"
+#include "rng.h"
+
+//past 1e12 doubles can't place --render lod's triangles to within a pixel
+#define CAMERA_MIN_ZOOM 1e-3
+#define CAMERA_MAX_ZOOM 1e12
+
+//sides of a --tiled image, 2^20 squared is 3 TB of ppm
+#define TILED_MAX_SIZE 1048576u
+
+typedef struct config {
+    uint64_t seed;
+    rng_kind rng;
+    uint32_t threads;
+    const char* isa;
+    //generate the points with the compute shader instead of on the cpu
+    uint32_t gpuGenerate;
+    //8 byte PackedVertex instead of the 20 byte Vertex in vertex buffers
+    uint32_t packedVertices;
+    //the maps the chaos game iterates, the gasket unless --fractal says otherwise
+    ifs fractal;
+
+    uint32_t points;
+    uint32_t width;
+    uint32_t height;
+    uint32_t framesInFlight;
+    //0 = draw all points every frame, otherwise generate this many per frame
+    //and accumulate them into an image that is never cleared
+    uint32_t pointsPerFrame;
+    //bin the points into a density histogram and tonemap it instead of
+    //drawing every point
+    uint32_t histogram;
+    float gamma;
+    //draw the depth subdivisionDepth gasket as indexed triangles instead of
+    //points, --points is ignored
+    uint32_t subdivision;
+    //the same triangles as 3^subdivisionDepth instances of one triangle
+    uint32_t instanced;
+    uint32_t subdivisionDepth;
+    //only the sub-triangles inside the view, subdivided until they are
+    //lodPixels across, regenerated whenever the camera moves
+    uint32_t lod;
+    float lodPixels;
+
+    //initial camera: the point at the middle of the view and the
+    //magnification, 1 shows [-1,1]^2. scroll and drag change it, within
+    //CAMERA_MIN_ZOOM to CAMERA_MAX_ZOOM
+    double center[2];
+    double zoom;
+
+    //write the point set to a file and exit instead of opening a window
+    const char* exportPoints;
+    point_layout pointLayout;
+    //draw the points stored in this file instead of generating them,
+    //--points becomes the file's count
+    const char* loadPoints;
+    //0 = the whole file is uploaded, otherwise at most this many of its
+    //points are kept on the gpu and the rest streamed in as the view needs
+    uint32_t residentPoints;
+
+    //0 = interactive, otherwise render this many frames and report draw cost
+    uint32_t benchFrames;
+    //non NULL = no window, render offscreen and write the frames here, in
+    //the format its extension names
+    const char* headlessOutput;
+    image_format headlessFormat;
+    uint32_t headlessFrames;
+    //threads encoding and writing headless frames
+    uint32_t encoders;
+    //non zero = write one tiledWidth x tiledHeight headless image instead,
+    //rendered as tiles of at most tileSize (or the device's limit) squared
+    uint32_t tiledWidth;
+    uint32_t tiledHeight;
+    uint32_t tileSize;
+
+    //seeds and receives the VkPipelineCache, NULL = don't persist it. under
+    //the user's cache directory unless set
+    const char* pipelineCachePath;
+
+    //re-record every frame's command buffer instead of reusing it
+    uint32_t recordEveryFrame;
+    //0 = the point set pass is recorded inline, otherwise by this many
+    //threads into secondary command buffers
+    uint32_t recordThreads;
+} config;
+
+//fills cfg with defaults, then applies a --config file (if given) and then
+//the remaining argv on top, so the command line always wins. returns false
+//on bad input or --help, after printing usage. free_config cfg either way
+int parse_args(int argc, char** argv, config* cfg);
+//frees the option strings cfg owns
+void free_config(config* cfg);
+
+//key = value lines, keys are the long option names without the dashes.
+//blank lines and lines starting with # are ignored
+int load_config_file(const char* path, config* cfg);
+void print_usage(const char* prog);
+
+#endif
@@ -0,0 +1,204 @@
+#include "encoder.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct cell {
+    //pos when free for the push at pos, pos + 1 once that push is readable
+    _Atomic uint64_t seq;
+    encode_job job;
+} cell;
+
+struct encoder_pool {
+    cell* ring;
+    //capacity plus one stop job per thread
+    uint32_t size;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    sem_t items;
+
+    pthread_t* threads;
+    uint32_t numThreads;
+
+    const char* path;
+    image_format format;
+    uint32_t width;
+    uint32_t height;
+    uint64_t numFrames;
+    //set for encoder_create_tiled, then path and the frame size are unused
+    tiled_image* tiled;
+
+    _Atomic uint64_t bytes;
+    atomic_int failed;
+};
+
+void encoder_push(encoder_pool* pool, const encode_job* job) {
+    //single producer, head is only ever touched here
+    uint64_t pos = atomic_load_explicit(&pool->head, memory_order_relaxed);
+    cell* c = &pool->ring[pos % pool->size];
+    //only reachable if the caller broke the capacity contract
+    while (atomic_load_explicit(&c->seq, memory_order_acquire) != pos) {
+        sched_yield();
+    }
+    c->job = *job;
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+    atomic_store_explicit(&pool->head, pos + 1, memory_order_relaxed);
+    sem_post(&pool->items);
+}
+
+static encode_job pop(encoder_pool* pool) {
+    while (sem_wait(&pool->items) != 0 && errno == EINTR) {
+    }
+
+    //the semaphore guarantees a published job exists, the cas only decides
+    //which encoder gets it
+    uint64_t pos = atomic_load_explicit(&pool->tail, memory_order_relaxed);
+    for (;;) {
+        cell* c = &pool->ring[pos % pool->size];
+        uint64_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        if (seq == pos + 1) {
+            if (atomic_compare_exchange_weak_explicit(&pool->tail, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                encode_job job = c->job;
+                atomic_store_explicit(&c->seq, pos + pool->size, memory_order_release);
+                return job;
+            }
+        } else if (seq <= pos) {
+            //claimed ahead of its publication, wait for the producer
+            sched_yield();
+            pos = atomic_load_explicit(&pool->tail, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&pool->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static void* encoder_worker(void* arg) {
+    encoder_pool* pool = arg;
+    char path[4096];
+    for (;;) {
+        encode_job job = pop(pool);
+        if (job.rgba == NULL) {
+            return NULL;
+        }
+
+        if (pool->tiled) {
+            uint64_t bytes = 0;
+            if (!tiled_image_write(pool->tiled, job.x, job.y, job.width, job.height,
+                        job.rgba, job.rowPitch, &bytes)) {
+                atomic_store(&pool->failed, true);
+            }
+            atomic_fetch_add_explicit(&pool->bytes, bytes, memory_order_relaxed);
+            sem_post(job.done);
+            continue;
+        }
+
+        const char* out = pool->path;
+        if (pool->numFrames > 1) {
+            if (!image_sequence_path(pool->path, job.frame, path, sizeof(path))) {
+                fprintf(stderr, "ERROR: output path too long for frame %llu\n",
+                        (unsigned long long) job.frame);
+                atomic_store(&pool->failed, true);
+                sem_post(job.done);
+                continue;
+            }
+            out = path;
+        }
+
+        uint64_t bytes = 0;
+        if (!write_image(out, pool->format, pool->width, pool->height, job.rgba,
+                    job.rowPitch, &bytes)) {
+            atomic_store(&pool->failed, true);
+        }
+        atomic_fetch_add_explicit(&pool->bytes, bytes, memory_order_relaxed);
+        sem_post(job.done);
+    }
+}
+
+static encoder_pool* encoder_start(uint32_t threads, uint32_t capacity, const char* path,
+        image_format format, uint32_t width, uint32_t height, uint64_t numFrames,
+        tiled_image* tiled) {
+    encoder_pool* pool = calloc(1, sizeof(encoder_pool));
+    if (!pool) {
+        fprintf(stderr, "ERROR: Couldn't allocate encoder pool\n");
+        return NULL;
+    }
+    pool->size = capacity + threads;
+    pool->ring = calloc(pool->size, sizeof(cell));
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->ring || !pool->threads || sem_init(&pool->items, 0, 0) != 0) {
+        fprintf(stderr, "ERROR: Couldn't allocate encoder pool\n");
+        free(pool->ring);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < pool->size; i++) {
+        atomic_init(&pool->ring[i].seq, i);
+    }
+    pool->path = path;
+    pool->format = format;
+    pool->width = width;
+    pool->height = height;
+    pool->numFrames = numFrames;
+    pool->tiled = tiled;
+
+    for (uint32_t t = 0; t < threads; t++) {
+        if (pthread_create(&pool->threads[t], NULL, encoder_worker, pool) != 0) {
+            fprintf(stderr, "WARNING: Couldn't start encoder thread %u\n", t);
+            break;
+        }
+        pool->numThreads++;
+    }
+    if (pool->numThreads == 0) {
+        fprintf(stderr, "ERROR: Couldn't start any encoder threads\n");
+        sem_destroy(&pool->items);
+        free(pool->ring);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+encoder_pool* encoder_create(uint32_t threads, uint32_t capacity, const char* path,
+        image_format format, uint32_t width, uint32_t height, uint64_t numFrames) {
+    return encoder_start(threads, capacity, path, format, width, height, numFrames, NULL);
+}
+
+encoder_pool* encoder_create_tiled(uint32_t threads, uint32_t capacity, tiled_image* image) {
+    return encoder_start(threads, capacity, NULL, image->format, image->width,
+            image->height, 1, image);
+}
+
+int encoder_finish(encoder_pool* pool, uint64_t* bytesWritten) {
+    //one stop job per thread, queued behind the real ones
+    encode_job stop = {};
+    for (uint32_t t = 0; t < pool->numThreads; t++) {
+        encoder_push(pool, &stop);
+    }
+
+    int ok = true;
+    for (uint32_t t = 0; t < pool->numThreads; t++) {
+        if (pthread_join(pool->threads[t], NULL) != 0) {
+            fprintf(stderr, "ERROR: Couldn't join encoder thread %u\n", t);
+            ok = false;
+        }
+    }
+    if (atomic_load(&pool->failed)) {
+        ok = false;
+    }
+    if (bytesWritten) {
+        *bytesWritten = atomic_load(&pool->bytes);
+    }
+
+    sem_destroy(&pool->items);
+    free(pool->ring);
+    free(pool->threads);
+    free(pool);
+    return ok;
+}
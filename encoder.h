@@ -0,0 +1,43 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <semaphore.h>
+#include <stdint.h>
+#include "image_io.h"
+
+//a pool of threads encoding finished frames to image files. the render
+//thread is the only producer. jobs go through a bounded lock-free ring:
+//every cell carries a sequence number and consumers claim cells with a cas.
+//the semaphore only parks idle encoders so they don't spin
+
+typedef struct encode_job {
+    const uint8_t* rgba;
+    size_t rowPitch;
+    uint64_t frame;
+    //tiled pools only: where rgba goes in the image and its size
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    //posted once rgba has been written out and may be overwritten
+    sem_t* done;
+} encode_job;
+
+typedef struct encoder_pool encoder_pool;
+
+//every frame goes to path in format. numFrames > 1 writes a numbered
+//sequence, see image_sequence_path. at most capacity jobs may be pending
+encoder_pool* encoder_create(uint32_t threads, uint32_t capacity, const char* path,
+        image_format format, uint32_t width, uint32_t height, uint64_t numFrames);
+
+//every job is one region of image instead, which stays owned by the caller
+encoder_pool* encoder_create_tiled(uint32_t threads, uint32_t capacity, tiled_image* image);
+
+//never blocks, the caller keeps at most capacity jobs outstanding
+void encoder_push(encoder_pool* pool, const encode_job* job);
+
+//waits for every pushed job, stops the threads and frees the pool. false if
+//any frame failed to write
+int encoder_finish(encoder_pool* pool, uint64_t* bytesWritten);
+
+#endif
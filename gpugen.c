@@ -0,0 +1,459 @@
+#include "gpugen.h"
+#include "arena.h"
+#include "camera.h"
+#include "pipelinecache.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//must match local_size_x in chaos.comp.glsl
+#define GPUGEN_GROUP_SIZE 64
+//walkers per dispatch and points each of them emits. every walker pays the
+//ifs burn in (32 steps for the gasket), so it should emit a lot more than that, but
+//small batches still get enough walkers to fill the gpu
+#define GPUGEN_WALKERS 65536
+#define GPUGEN_MIN_WALKERS 4096
+#define GPUGEN_STEPS 1024
+
+//push constant block of chaos.comp.glsl
+typedef struct gpugenParams {
+    uint32_t seedLo;
+    uint32_t seedHi;
+    uint32_t base;
+    uint32_t count;
+    uint32_t walkers;
+    uint32_t firstWalker;
+    uint32_t width;
+    uint32_t height;
+    uint32_t drawSlot;
+    uint32_t pad;
+    float center[2];
+    float zoom[2];
+    float bound[2];
+} gpugenParams;
+
+//std430 layout of the Maps buffer in chaos.comp.glsl
+typedef struct gpugenMap {
+    float linear[4];
+    float offset[2];
+    uint32_t threshold;
+    uint32_t alias;
+    float color[4];
+} gpugenMap;
+
+typedef struct gpugenIfs {
+    uint32_t numMaps;
+    uint32_t burnIn;
+    uint32_t weighted;
+    uint32_t pad;
+    gpugenMap maps[IFS_MAX_MAPS];
+} gpugenIfs;
+
+_Static_assert(sizeof(gpugenMap) == 48, "gpugenMap must match the std430 layout");
+
+//the maps and their alias table, written once. small enough that host
+//visible memory costs nothing measurable, the shader caches it anyway
+static int createIfsBuffer(ctx* ctx) {
+    gpugenState* g = &ctx->gpugen;
+    const ifs* system = &ctx->cfg.fractal;
+    gpugenIfs data = {
+        .numMaps = system->numMaps,
+        .burnIn = system->burnIn,
+        .weighted = !system->uniform,
+    };
+    for (uint32_t i = 0; i < system->numMaps; i++) {
+        const ifs_map* m = &system->maps[i];
+        data.maps[i] = (gpugenMap) {
+            .linear = { m->a, m->b, m->c, m->d },
+            .offset = { m->e, m->f },
+            .threshold = system->threshold[i],
+            .alias = system->alias[i],
+            .color = { m->color[0], m->color[1], m->color[2], 0.0f },
+        };
+    }
+
+    if (!createBuffer(
+            ctx,
+            sizeof(data),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &g->ifsBuffer,
+            &g->ifsMemory)) {
+        fprintf(stderr, "ERROR: Couldn't create chaos map buffer\n");
+        return false;
+    }
+    memcpy(g->ifsMemory.mapped, &data, sizeof(data));
+    return true;
+}
+
+static int graphicsQueueHasCompute(ctx* ctx) {
+    qfi indices;
+    findQueueFamilies(ctx->physicalDevice, ctx->surface, &indices);
+
+    uint32_t count;
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx->physicalDevice, &count, NULL);
+    VkQueueFamilyProperties families[count];
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx->physicalDevice, &count, families);
+    return families[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT;
+}
+
+static int createGpugenPipeline(ctx* ctx, VkBuffer target, VkDeviceSize size,
+        uint32_t drawSlots, VkBool32 histogram, VkBool32 cull) {
+    gpugenState* g = &ctx->gpugen;
+    if (!graphicsQueueHasCompute(ctx)) {
+        fprintf(stderr, "ERROR: graphics queue can't run compute, use --generator cpu\n");
+        return false;
+    }
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->physicalDevice, &props);
+    if (size > props.limits.maxStorageBufferRange) {
+        fprintf(stderr, "ERROR: the points need %llu bytes, the device can only bind "
+                "%u as a storage buffer\n", (unsigned long long) size,
+                props.limits.maxStorageBufferRange);
+        return false;
+    }
+
+    if (!createIfsBuffer(ctx)) {
+        return false;
+    }
+
+    //the histogram variant never draws, but the binding still needs a buffer
+    g->drawSlots = drawSlots ? drawSlots : 1;
+    if (!createBuffer(
+            ctx,
+            g->drawSlots * sizeof(VkDrawIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &g->drawBuffer,
+            &g->drawMemory)) {
+        fprintf(stderr, "ERROR: Couldn't create chaos draw buffer\n");
+        return false;
+    }
+    g->cull = cull;
+
+    //0 is the output, 1 the maps, 2 the draws
+    VkDescriptorSetLayoutBinding bindings[3] = {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+    };
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 3,
+        .pBindings = bindings,
+    };
+    if (vkCreateDescriptorSetLayout(ctx->logicalDevice, &setLayoutInfo, NULL,
+                &g->setLayout) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create chaos descriptor set layout\n");
+        return false;
+    }
+
+    VkPushConstantRange pushRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(gpugenParams),
+    };
+    VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &g->setLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushRange,
+    };
+    if (vkCreatePipelineLayout(ctx->logicalDevice, &layoutInfo, NULL,
+                &g->pipelineLayout) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create chaos pipeline layout\n");
+        return false;
+    }
+
+    VkShaderModule computeShader;
+    if (!createShader(ctx->logicalDevice, COMP_SHADER, &computeShader)) {
+        fprintf(stderr, "Compute shader couldn't be loaded\n");
+        return false;
+    }
+
+    //constant_id 0 is HISTOGRAM, 1 is PACKED, 2 is CULL
+    VkBool32 specData[3] = { histogram, ctx->cfg.packedVertices != 0, cull };
+    VkSpecializationMapEntry specEntries[3] = {
+        { .constantID = 0, .offset = 0, .size = sizeof(VkBool32) },
+        { .constantID = 1, .offset = sizeof(VkBool32), .size = sizeof(VkBool32) },
+        { .constantID = 2, .offset = 2 * sizeof(VkBool32), .size = sizeof(VkBool32) },
+    };
+    VkSpecializationInfo specInfo = {
+        .mapEntryCount = 3,
+        .pMapEntries = specEntries,
+        .dataSize = sizeof(specData),
+        .pData = specData,
+    };
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = computeShader,
+            .pName = "main",
+            .pSpecializationInfo = &specInfo,
+        },
+        .layout = g->pipelineLayout,
+    };
+    double start = pipelineCacheClock();
+    VkResult result = vkCreateComputePipelines(ctx->logicalDevice, ctx->pipelineCache.cache,
+            1, &pipelineInfo, NULL, &g->pipeline);
+    ctx->pipelineCache.createMs += pipelineCacheClock() - start;
+    vkDestroyShaderModule(ctx->logicalDevice, computeShader, NULL);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create chaos compute pipeline\n");
+        return false;
+    }
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 3,
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+    };
+    if (vkCreateDescriptorPool(ctx->logicalDevice, &poolInfo, NULL,
+                &g->descriptorPool) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create chaos descriptor pool\n");
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = g->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &g->setLayout,
+    };
+    if (vkAllocateDescriptorSets(ctx->logicalDevice, &allocInfo, &g->descriptorSet)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate chaos descriptor set\n");
+        return false;
+    }
+
+    VkDescriptorBufferInfo bufferInfos[3] = {
+        { .buffer = target, .offset = 0, .range = size },
+        { .buffer = g->ifsBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = g->drawBuffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    };
+    VkWriteDescriptorSet writes[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        writes[i] = (VkWriteDescriptorSet) {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = g->descriptorSet,
+            .dstBinding = i,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &bufferInfos[i],
+        };
+    }
+    vkUpdateDescriptorSets(ctx->logicalDevice, 3, writes, 0, NULL);
+
+    return true;
+}
+
+int createGpugen(ctx* ctx, VkBuffer target, VkDeviceSize size, uint32_t drawSlots,
+        VkBool32 cull) {
+    return createGpugenPipeline(ctx, target, size, drawSlots, VK_FALSE, cull);
+}
+
+int createGpugenHistogram(ctx* ctx, VkBuffer target, uint32_t width, uint32_t height) {
+    ctx->gpugen.histogramWidth = width;
+    ctx->gpugen.histogramHeight = height;
+    return createGpugenPipeline(ctx, target, gpugenHistogramSize(width, height), 0,
+            VK_TRUE, VK_FALSE);
+}
+
+VkDeviceSize gpugenHistogramSize(uint32_t width, uint32_t height) {
+    return (GPUGEN_HIST_HEADER + (VkDeviceSize) width * height * CHAOS_HIST_CHANNELS)
+        * sizeof(uint32_t);
+}
+
+void destroyGpugen(ctx* ctx) {
+    gpugenState* g = &ctx->gpugen;
+    if (g->pipeline) { vkDestroyPipeline(ctx->logicalDevice, g->pipeline, NULL); }
+    if (g->pipelineLayout) { vkDestroyPipelineLayout(ctx->logicalDevice, g->pipelineLayout, NULL); }
+    if (g->descriptorPool) { vkDestroyDescriptorPool(ctx->logicalDevice, g->descriptorPool, NULL); }
+    if (g->setLayout) { vkDestroyDescriptorSetLayout(ctx->logicalDevice, g->setLayout, NULL); }
+    if (g->ifsBuffer) { vkDestroyBuffer(ctx->logicalDevice, g->ifsBuffer, NULL); }
+    arenaFree(ctx, &g->ifsMemory);
+    if (g->drawBuffer) { vkDestroyBuffer(ctx->logicalDevice, g->drawBuffer, NULL); }
+    arenaFree(ctx, &g->drawMemory);
+    memset(g, 0, sizeof(gpugenState));
+}
+
+static void recordDispatches(ctx* ctx, VkCommandBuffer commandBuffer, uint64_t first,
+        uint64_t numPoints, uint32_t drawSlot) {
+    gpugenState* g = &ctx->gpugen;
+    //a pixel of margin, a point centered just outside still covers one
+    vertexParams view = cameraVertexParams(ctx);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, g->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+            g->pipelineLayout, 0, 1, &g->descriptorSet, 0, NULL);
+
+    const uint64_t perDispatch = (uint64_t) GPUGEN_WALKERS * GPUGEN_STEPS;
+    for (uint64_t done = 0; done < numPoints; done += perDispatch) {
+        uint64_t count = numPoints - done < perDispatch ? numPoints - done : perDispatch;
+        uint64_t walkers = (count + GPUGEN_STEPS - 1) / GPUGEN_STEPS;
+        if (walkers < GPUGEN_MIN_WALKERS) {
+            walkers = count < GPUGEN_MIN_WALKERS ? count : GPUGEN_MIN_WALKERS;
+        }
+
+        //new walkers every dispatch, so no two batches repeat a sequence.
+        //culled points are appended after the ones kept by earlier dispatches
+        gpugenParams params = {
+            .seedLo = (uint32_t) ctx->cfg.seed,
+            .seedHi = (uint32_t) (ctx->cfg.seed >> 32),
+            .base = (uint32_t) (g->cull ? first : first + done),
+            .count = (uint32_t) count,
+            .walkers = (uint32_t) walkers,
+            .firstWalker = g->nextWalker,
+            .width = g->histogramWidth,
+            .height = g->histogramHeight,
+            .drawSlot = drawSlot,
+            .center = { view.center[0], view.center[1] },
+            .zoom = { view.zoom[0], view.zoom[1] },
+            .bound = {
+                1.0f + 2.0f / ctx->swapchainExtent.width,
+                1.0f + 2.0f / ctx->swapchainExtent.height,
+            },
+        };
+        vkCmdPushConstants(commandBuffer, g->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                0, sizeof(params), &params);
+        vkCmdDispatch(commandBuffer,
+                (uint32_t) ((walkers + GPUGEN_GROUP_SIZE - 1) / GPUGEN_GROUP_SIZE), 1, 1);
+        g->nextWalker += (uint32_t) walkers;
+    }
+}
+
+//the dispatches write disjoint ranges, or append through atomics, so they
+//need no barriers between them. only the draw's count has to be reset
+//before them, and everything made visible to the draw after them
+void recordGpugen(ctx* ctx, VkCommandBuffer commandBuffer, VkBuffer target,
+        uint64_t first, uint64_t numPoints, uint32_t drawSlot) {
+    gpugenState* g = &ctx->gpugen;
+    VkDeviceSize drawOffset = drawSlot * sizeof(VkDrawIndirectCommand);
+    VkDrawIndirectCommand reset = { .vertexCount = 0, .instanceCount = 1 };
+    vkCmdUpdateBuffer(commandBuffer, g->drawBuffer, drawOffset, sizeof(reset), &reset);
+
+    VkBufferMemoryBarrier toCount = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = g->drawBuffer,
+        .offset = drawOffset,
+        .size = sizeof(VkDrawIndirectCommand),
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1, &toCount, 0, NULL);
+
+    recordDispatches(ctx, commandBuffer, first, numPoints, drawSlot);
+
+    VkBufferMemoryBarrier toDraw[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = target,
+            .offset = first * vertexStride(ctx),
+            .size = numPoints * vertexStride(ctx),
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = g->drawBuffer,
+            .offset = drawOffset,
+            .size = sizeof(VkDrawIndirectCommand),
+        },
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            0, 0, NULL, 2, toDraw, 0, NULL);
+}
+
+void recordGpugenDraw(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t drawSlot) {
+    vkCmdDrawIndirect(commandBuffer, ctx->gpugen.drawBuffer,
+            drawSlot * sizeof(VkDrawIndirectCommand), 1, sizeof(VkDrawIndirectCommand));
+}
+
+//the dispatches only touch the histogram through atomics, so they can
+//overlap each other freely
+void recordGpugenHistogram(ctx* ctx, VkCommandBuffer commandBuffer, VkBuffer target,
+        uint64_t numPoints) {
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = target,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+    vkCmdFillBuffer(commandBuffer, target, 0, VK_WHOLE_SIZE, 0);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+    recordDispatches(ctx, commandBuffer, 0, numPoints, 0);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+int createGpuVertexBuffer(ctx* ctx) {
+    VkDeviceSize bufferSize = vertexStride(ctx) * ctx->cfg.points;
+    if (!createBuffer(
+            ctx,
+            bufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &ctx->vertexBuffer,
+            &ctx->vertexBufferMemory)) {
+        fprintf(stderr, "ERROR: Failed to create vertex buffer\n");
+        return false;
+    }
+
+    //every point is kept, the view can still move
+    if (!createGpugen(ctx, ctx->vertexBuffer, bufferSize, 1, VK_FALSE)) {
+        return false;
+    }
+
+    //the draw goes through the same queue, the barrier orders it after this
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(ctx, ctx->graphicsCommandPool);
+    if (commandBuffer == VK_NULL_HANDLE) {
+        return false;
+    }
+    recordGpugen(ctx, commandBuffer, ctx->vertexBuffer, 0, ctx->cfg.points, 0);
+    return endSingleTimeCommands(ctx, ctx->graphicsCommandPool, ctx->graphicsQueue,
+            commandBuffer);
+}
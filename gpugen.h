@@ -0,0 +1,44 @@
+#ifndef GPUGEN_H
+#define GPUGEN_H
+
+#include "vulkan.h"
+
+//--generator gpu. thousands of independent walkers run in a compute shader
+//and write straight into a device local buffer that is also the vertex
+//buffer, so the points are never generated or uploaded by the host
+
+//the point counts are written by the compute shader into an indirect draw
+//buffer with drawSlots commands, so a draw never needs the count on the host,
+//which it doesn't have when the shader culls
+
+//creates ctx->vertexBuffer and fills it. the pipeline stays for the draw
+//command in slot 0, destroyGpugen goes with the vertex buffer
+int createGpuVertexBuffer(ctx* ctx);
+
+//compute pipeline writing into the first size bytes of target, which needs
+//STORAGE_BUFFER usage. with cull only points in the camera's view are kept
+int createGpugen(ctx* ctx, VkBuffer target, VkDeviceSize size, uint32_t drawSlots,
+        VkBool32 cull);
+
+//writes up to numPoints fresh points starting at point index first and sets
+//draw command drawSlot to them, followed by a barrier that makes both visible
+//to the draw. the command's firstVertex is 0, bind target at first
+void recordGpugen(ctx* ctx, VkCommandBuffer commandBuffer, VkBuffer target,
+        uint64_t first, uint64_t numPoints, uint32_t drawSlot);
+//draws what the last recordGpugen for drawSlot wrote
+void recordGpugenDraw(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t drawSlot);
+void destroyGpugen(ctx* ctx);
+
+//histogram variant: the same walkers bin their points into target with
+//atomics instead of storing them, see chaos.comp.glsl for the layout. the
+//first GPUGEN_HIST_HEADER words hold the approximate max hit count
+#define GPUGEN_HIST_HEADER 4
+VkDeviceSize gpugenHistogramSize(uint32_t width, uint32_t height);
+int createGpugenHistogram(ctx* ctx, VkBuffer target, uint32_t width, uint32_t height);
+
+//clears target and bins numPoints fresh points into it, followed by a barrier
+//that makes the result visible to fragment shaders
+void recordGpugenHistogram(ctx* ctx, VkCommandBuffer commandBuffer, VkBuffer target,
+        uint64_t numPoints);
+
+#endif
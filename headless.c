@@ -0,0 +1,459 @@
+#include "headless.h"
+#include "arena.h"
+#include "bench.h"
+#include "camera.h"
+#include "encoder.h"
+#include "lod.h"
+#include "record.h"
+#include "stream.h"
+#include "upload.h"
+#include <errno.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//srgb like the window's surface format, so the file matches the screen.
+//rgba order means the readback needs no swizzle
+#define OFFSCREEN_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+
+struct readbackSlot {
+    VkBuffer buffer;
+    memAlloc memory;
+    uint8_t* mapped;
+    uint64_t frame;
+    //--tiled: the part of the image the frame holds
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    //posted by the encoder once the frame is on disk and the slot can be
+    //copied into again
+    sem_t free;
+    uint32_t hasSemaphore;
+};
+
+static double nowMs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+//as large as --tile-size and the device allow, but no larger than the image
+static void pickTileExtent(ctx* ctx) {
+    headlessState* h = &ctx->headless;
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->physicalDevice, &props);
+    uint32_t limit = ctx->cfg.tileSize;
+    uint32_t deviceLimits[] = {
+        props.limits.maxImageDimension2D,
+        props.limits.maxFramebufferWidth,
+        props.limits.maxFramebufferHeight,
+    };
+    for (uint32_t i = 0; i < sizeof(deviceLimits) / sizeof(deviceLimits[0]); i++) {
+        if (deviceLimits[i] < limit) {
+            limit = deviceLimits[i];
+        }
+    }
+
+    uint32_t width = ctx->cfg.tiledWidth, height = ctx->cfg.tiledHeight;
+    ctx->swapchainExtent.width = width < limit ? width : limit;
+    ctx->swapchainExtent.height = height < limit ? height : limit;
+    h->tilesAcross = (width + ctx->swapchainExtent.width - 1) / ctx->swapchainExtent.width;
+    h->tilesDown = (height + ctx->swapchainExtent.height - 1) / ctx->swapchainExtent.height;
+}
+
+int createOffscreenTarget(ctx* ctx) {
+    headlessState* h = &ctx->headless;
+    ctx->swapchainImageFormat = OFFSCREEN_FORMAT;
+    if (ctx->cfg.tiledWidth) {
+        pickTileExtent(ctx);
+    } else {
+        ctx->swapchainExtent.width = ctx->cfg.width;
+        ctx->swapchainExtent.height = ctx->cfg.height;
+    }
+
+    //one per frame slot, so rendering a frame never waits on the copy of the
+    //previous one
+    ctx->numSwapchainImages = ctx->MAX_FRAMES_IN_FLIGHT;
+    ctx->swapchainImages = calloc(ctx->numSwapchainImages, sizeof(VkImage));
+    h->imageMemory = calloc(ctx->numSwapchainImages, sizeof(memAlloc));
+    if (!ctx->swapchainImages || !h->imageMemory) {
+        fprintf(stderr, "ERROR: Couldn't allocate offscreen targets\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ctx->numSwapchainImages; i++) {
+        if (!createImage(ctx, ctx->swapchainExtent.width, ctx->swapchainExtent.height,
+                    OFFSCREEN_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    &ctx->swapchainImages[i], &h->imageMemory[i])) {
+            fprintf(stderr, "ERROR: Couldn't create offscreen image\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+//the encoders read every byte of the frame, so cached memory is worth a lot
+//more than coherence here. falls back to coherent uncached memory
+static int pickReadbackMemory(ctx* ctx, uint32_t typeBits, uint32_t* type,
+        uint32_t* coherent) {
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(ctx->physicalDevice, &memProps);
+    VkMemoryPropertyFlags wanted[] = {
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    };
+    for (uint32_t w = 0; w < sizeof(wanted) / sizeof(wanted[0]); w++) {
+        for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+            VkMemoryPropertyFlags flags = memProps.memoryTypes[i].propertyFlags;
+            if (typeBits & (1u << i) && (flags & wanted[w]) == wanted[w]) {
+                *type = i;
+                *coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+                return true;
+            }
+        }
+    }
+    fprintf(stderr, "ERROR: couldn't find host visible memory for readback\n");
+    return false;
+}
+
+static int createReadbackSlot(ctx* ctx, readbackSlot* slot, VkDeviceSize size,
+        int32_t* memoryType) {
+    headlessState* h = &ctx->headless;
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    if (vkCreateBuffer(ctx->logicalDevice, &bufferInfo, NULL, &slot->buffer)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create readback buffer\n");
+        return false;
+    }
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(ctx->logicalDevice, slot->buffer, &memReqs);
+    if (*memoryType < 0) {
+        uint32_t type;
+        if (!pickReadbackMemory(ctx, memReqs.memoryTypeBits, &type, &h->coherent)) {
+            return false;
+        }
+        *memoryType = type;
+    }
+
+    if (!arenaAllocType(ctx, &memReqs, *memoryType, true, &slot->memory)) {
+        fprintf(stderr, "ERROR: Couldn't allocate readback memory\n");
+        return false;
+    }
+    vkBindBufferMemory(ctx->logicalDevice, slot->buffer, slot->memory.memory,
+            slot->memory.offset);
+    //mapped for the whole run by the arena, the encoders read straight out of it
+    slot->mapped = slot->memory.mapped;
+
+    if (sem_init(&slot->free, 0, 1) != 0) {
+        fprintf(stderr, "ERROR: Couldn't create readback semaphore\n");
+        return false;
+    }
+    slot->hasSemaphore = true;
+    return true;
+}
+
+int createReadback(ctx* ctx) {
+    headlessState* h = &ctx->headless;
+    VkDeviceSize size = (VkDeviceSize) ctx->swapchainExtent.width
+        * ctx->swapchainExtent.height * 4;
+
+    //every frame in flight holds a slot while it is copied, every encoder
+    //one while it writes. with fewer the render loop would wait on the disk
+    h->numSlots = ctx->MAX_FRAMES_IN_FLIGHT + ctx->cfg.encoders;
+    h->slots = calloc(h->numSlots, sizeof(readbackSlot));
+    h->copyCommandBuffers = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(VkCommandBuffer));
+    h->pendingSlot = malloc(ctx->MAX_FRAMES_IN_FLIGHT * sizeof(int32_t));
+    if (!h->slots || !h->copyCommandBuffers || !h->pendingSlot) {
+        fprintf(stderr, "ERROR: Couldn't allocate readback ring\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < ctx->MAX_FRAMES_IN_FLIGHT; i++) {
+        h->pendingSlot[i] = -1;
+    }
+
+    int32_t memoryType = -1;
+    for (uint32_t i = 0; i < h->numSlots; i++) {
+        if (!createReadbackSlot(ctx, &h->slots[i], size, &memoryType)) {
+            return false;
+        }
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx->graphicsCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = ctx->MAX_FRAMES_IN_FLIGHT,
+    };
+    if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, h->copyCommandBuffers)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate readback command buffers\n");
+        return false;
+    }
+    return true;
+}
+
+//the render pass leaves the image in TRANSFER_SRC_OPTIMAL, and its end
+//dependency orders the copy after the frame's writes
+static int recordReadback(ctx* ctx, VkCommandBuffer commandBuffer, VkImage image,
+        VkBuffer buffer) {
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't begin readback command buffer\n");
+        return false;
+    }
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { ctx->swapchainExtent.width, ctx->swapchainExtent.height, 1 },
+    };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            buffer, 1, &region);
+
+    VkMemoryBarrier toHost = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &toHost, 0, NULL, 0, NULL);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't record readback command buffer\n");
+        return false;
+    }
+    return true;
+}
+
+//waits for the current frame slot's fence, then hands the frame it copied
+//(if any) to the encoders
+static void collectFrame(ctx* ctx, encoder_pool* encoders) {
+    headlessState* h = &ctx->headless;
+    uint32_t frameSlot = ctx->currentFrame;
+    vkWaitForFences(ctx->logicalDevice, 1, &ctx->inFlightFences[frameSlot], VK_TRUE,
+            UINT64_MAX);
+    benchCollect(ctx);
+
+    if (h->pendingSlot[frameSlot] < 0) {
+        return;
+    }
+    readbackSlot* slot = &h->slots[h->pendingSlot[frameSlot]];
+    h->pendingSlot[frameSlot] = -1;
+    if (!h->coherent) {
+        VkMappedMemoryRange range = {
+            .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+            .memory = slot->memory.memory,
+            .offset = slot->memory.offset,
+            .size = slot->memory.size,
+        };
+        vkInvalidateMappedMemoryRanges(ctx->logicalDevice, 1, &range);
+    }
+
+    encode_job job = {
+        .rgba = slot->mapped,
+        .rowPitch = (size_t) ctx->swapchainExtent.width * 4,
+        .frame = slot->frame,
+        .x = slot->x,
+        .y = slot->y,
+        .width = slot->width,
+        .height = slot->height,
+        .done = &slot->free,
+    };
+    encoder_push(encoders, &job);
+}
+
+static int renderFrame(ctx* ctx, encoder_pool* encoders, uint64_t frame) {
+    headlessState* h = &ctx->headless;
+    uint32_t frameSlot = frame % ctx->MAX_FRAMES_IN_FLIGHT;
+    ctx->currentFrame = frameSlot;
+    collectFrame(ctx, encoders);
+    uploadCollect(ctx);
+    if (ctx->cfg.lod && !lodUpdate(ctx)) {
+        return false;
+    }
+
+    //blocks only when the encoders fall a whole ring behind
+    uint32_t index = frame % h->numSlots;
+    readbackSlot* slot = &h->slots[index];
+    while (sem_wait(&slot->free) != 0 && errno == EINTR) {
+    }
+    slot->frame = frame;
+    if (ctx->cfg.tiledWidth) {
+        //edge tiles are rendered whole, only their part of the image is written
+        slot->x = (uint32_t) (frame % h->tilesAcross) * ctx->swapchainExtent.width;
+        slot->y = (uint32_t) (frame / h->tilesAcross) * ctx->swapchainExtent.height;
+        slot->width = ctx->cfg.tiledWidth - slot->x;
+        slot->height = ctx->cfg.tiledHeight - slot->y;
+        if (slot->width > ctx->swapchainExtent.width) {
+            slot->width = ctx->swapchainExtent.width;
+        }
+        if (slot->height > ctx->swapchainExtent.height) {
+            slot->height = ctx->swapchainExtent.height;
+        }
+        cameraSetTile(ctx, slot->x, slot->y, ctx->cfg.tiledWidth, ctx->cfg.tiledHeight);
+    }
+    //after the tile is set, only its chunks are loaded
+    if (ctx->cfg.residentPoints && !streamUpdate(ctx)) {
+        return false;
+    }
+
+    uploadWait upload;
+    if (!uploadGraphicsWait(ctx, frameSlot, &upload)) {
+        return false;
+    }
+    //the offscreen image of a frame slot stands in for its swapchain image.
+    //the copy goes to a different ring slot every time, it's always recorded
+    VkCommandBuffer commandBuffers[] = {
+        upload.acquire,
+        frameCommandBuffer(ctx, frameSlot),
+        h->copyCommandBuffers[frameSlot],
+    };
+    uint32_t firstCommandBuffer = upload.acquire ? 0 : 1;
+    vkResetCommandBuffer(commandBuffers[2], 0);
+    if (commandBuffers[1] == VK_NULL_HANDLE
+            || !recordReadback(ctx, commandBuffers[2], ctx->swapchainImages[frameSlot],
+                slot->buffer)) {
+        return false;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 1,
+        .pWaitSemaphoreValues = &upload.value,
+    };
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = upload.semaphore ? &timelineInfo : NULL,
+        .waitSemaphoreCount = upload.semaphore ? 1 : 0,
+        .pWaitSemaphores = &upload.semaphore,
+        .pWaitDstStageMask = &upload.stages,
+        .commandBufferCount = 3 - firstCommandBuffer,
+        .pCommandBuffers = &commandBuffers[firstCommandBuffer],
+    };
+    vkResetFences(ctx->logicalDevice, 1, &ctx->inFlightFences[frameSlot]);
+    if (vkQueueSubmit(ctx->graphicsQueue, 1, &submitInfo, ctx->inFlightFences[frameSlot])
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't submit offscreen frame %llu\n",
+                (unsigned long long) frame);
+        return false;
+    }
+    benchSubmitted(ctx);
+    h->pendingSlot[frameSlot] = index;
+    return true;
+}
+
+int renderHeadless(ctx* ctx) {
+    headlessState* h = &ctx->headless;
+    uint64_t numFrames = ctx->cfg.headlessFrames;
+    if (ctx->cfg.benchFrames > numFrames) {
+        numFrames = ctx->cfg.benchFrames;
+    }
+
+    //--tiled: every frame is one tile of the same image, the encoders write
+    //them into place as they come, so memory is bounded by the readback ring
+    tiled_image image = { .fd = -1 };
+    encoder_pool* encoders;
+    if (ctx->cfg.tiledWidth) {
+        numFrames = (uint64_t) h->tilesAcross * h->tilesDown;
+        if (!tiled_image_create(&image, ctx->cfg.headlessOutput, ctx->cfg.headlessFormat,
+                    ctx->cfg.tiledWidth, ctx->cfg.tiledHeight)) {
+            return false;
+        }
+        encoders = encoder_create_tiled(ctx->cfg.encoders, h->numSlots, &image);
+    } else {
+        encoders = encoder_create(ctx->cfg.encoders, h->numSlots, ctx->cfg.headlessOutput,
+                ctx->cfg.headlessFormat, ctx->swapchainExtent.width,
+                ctx->swapchainExtent.height, numFrames);
+    }
+    if (!encoders) {
+        tiled_image_close(&image);
+        return false;
+    }
+
+    double start = nowMs();
+    int ok = true;
+    uint64_t frame = 0;
+    for (; ok && frame < numFrames; frame++) {
+        ok = renderFrame(ctx, encoders, frame);
+    }
+
+    if (ok) {
+        //frames still in flight
+        for (uint32_t i = 0; i < ctx->MAX_FRAMES_IN_FLIGHT; i++) {
+            ctx->currentFrame = (frame + i) % ctx->MAX_FRAMES_IN_FLIGHT;
+            collectFrame(ctx, encoders);
+        }
+    } else {
+        //a failed submit leaves its fence unsignalled
+        vkDeviceWaitIdle(ctx->logicalDevice);
+    }
+
+    uint64_t bytes = 0;
+    if (!encoder_finish(encoders, &bytes)) {
+        ok = false;
+    }
+    if (!tiled_image_close(&image)) {
+        ok = false;
+    }
+    if (!ok) {
+        return false;
+    }
+
+    double seconds = (nowMs() - start) / 1000.0;
+    if (ctx->cfg.tiledWidth) {
+        fprintf(stdout, "headless: wrote %ux%u to %s as %llu tiles of %ux%u\n",
+                ctx->cfg.tiledWidth, ctx->cfg.tiledHeight, ctx->cfg.headlessOutput,
+                (unsigned long long) numFrames, ctx->swapchainExtent.width,
+                ctx->swapchainExtent.height);
+        fprintf(stdout, "headless: %.3f s, %.1f tiles/s, %.1f MB/s written, %u encoders\n",
+                seconds, numFrames / seconds, bytes / seconds / 1000000.0,
+                ctx->cfg.encoders);
+        return true;
+    }
+    fprintf(stdout, "headless: wrote %llu frames (%ux%u) to %s\n",
+            (unsigned long long) numFrames, ctx->swapchainExtent.width,
+            ctx->swapchainExtent.height, ctx->cfg.headlessOutput);
+    fprintf(stdout, "headless: %.3f s, %.1f frames/s, %.1f MB/s written, %u encoders\n",
+            seconds, numFrames / seconds, bytes / seconds / 1000000.0, ctx->cfg.encoders);
+    return true;
+}
+
+void destroyHeadless(ctx* ctx) {
+    headlessState* h = &ctx->headless;
+    if (h->slots) {
+        for (uint32_t i = 0; i < h->numSlots; i++) {
+            readbackSlot* slot = &h->slots[i];
+            if (slot->hasSemaphore) { sem_destroy(&slot->free); }
+            if (slot->buffer) { vkDestroyBuffer(ctx->logicalDevice, slot->buffer, NULL); }
+            arenaFree(ctx, &slot->memory);
+        }
+        free(h->slots);
+    }
+    if (h->copyCommandBuffers) { free(h->copyCommandBuffers); }
+    if (h->pendingSlot) { free(h->pendingSlot); }
+    if (h->imageMemory) {
+        for (uint32_t i = 0; i < ctx->numSwapchainImages; i++) {
+            if (ctx->swapchainImages[i]) { vkDestroyImage(ctx->logicalDevice, ctx->swapchainImages[i], NULL); }
+            arenaFree(ctx, &h->imageMemory[i]);
+        }
+        free(h->imageMemory);
+    }
+    memset(h, 0, sizeof(headlessState));
+}
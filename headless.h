@@ -0,0 +1,24 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "vulkan.h"
+
+//--headless FILE. no glfw window, surface or swapchain: frames are drawn
+//with the normal renderPass and graphicsPipeline into offscreen images
+//standing in for the swapchain, copied into a ring of host visible readback
+//buffers and written out by a pool of encoder threads, so the gpu renders
+//frame N+1 while frame N is copied and frame N-1 is encoded. needs nothing
+//but a graphics queue, so it runs on lavapipe
+
+//fills in the swapchain fields (format, extent, one image per frame slot)
+//from cfg. replaces createSwapchain
+int createOffscreenTarget(ctx* ctx);
+
+//readback ring and copy command buffers, needs the command pools
+int createReadback(ctx* ctx);
+
+//draws and writes max(1, --headless-frames) frames, or --bench-frames if more
+int renderHeadless(ctx* ctx);
+void destroyHeadless(ctx* ctx);
+
+#endif
@@ -0,0 +1,357 @@
+#include "histogram.h"
+#include "arena.h"
+#include "bench.h"
+#include "chaos.h"
+#include "gpugen.h"
+#include "pipelinecache.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//push constant block of tonemap.frag.glsl
+typedef struct tonemapParams {
+    uint32_t width;
+    uint32_t height;
+    uint32_t targetWidth;
+    uint32_t targetHeight;
+    float gamma;
+} tonemapParams;
+
+//bins into host memory first, the mapped staging memory is usually write
+//combined and the binning is all read-modify-write
+static int fillHistogram(void* dst, VkDeviceSize size, void* user) {
+    ctx* ctx = user;
+    histogramState* h = &ctx->histogram;
+    size_t numBins = (size_t) h->width * h->height * CHAOS_HIST_CHANNELS;
+    uint32_t* bins = malloc(numBins * sizeof(uint32_t));
+    if (!bins) {
+        fprintf(stderr, "ERROR: Couldn't allocate histogram\n");
+        return false;
+    }
+
+    chaos_engine engine;
+    int ok = chaos_init(&engine, &ctx->cfg.fractal, ctx->cfg.seed, ctx->cfg.threads,
+            ctx->cfg.rng)
+        && chaos_select_isa(&engine, ctx->cfg.isa)
+        && chaos_histogram(&engine, ctx->cfg.points, h->width, h->height, bins);
+    chaos_destroy(&engine);
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't bin points\n");
+        free(bins);
+        return false;
+    }
+
+    uint32_t header[GPUGEN_HIST_HEADER] = {0};
+    for (size_t i = 0; i < numBins; i += CHAOS_HIST_CHANNELS) {
+        if (bins[i] > header[0]) {
+            header[0] = bins[i];
+        }
+    }
+    memcpy(dst, header, sizeof(header));
+    memcpy((uint32_t*) dst + GPUGEN_HIST_HEADER, bins, numBins * sizeof(uint32_t));
+    free(bins);
+    return true;
+}
+
+static int binOnGpu(ctx* ctx, VkDeviceSize size) {
+    histogramState* h = &ctx->histogram;
+    if (!createBuffer(ctx, size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &h->buffer, &h->memory)) {
+        return false;
+    }
+
+    if (!createGpugenHistogram(ctx, h->buffer, h->width, h->height)) {
+        destroyGpugen(ctx);
+        return false;
+    }
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(ctx, ctx->graphicsCommandPool);
+    int ok = commandBuffer != VK_NULL_HANDLE;
+    if (ok) {
+        recordGpugenHistogram(ctx, commandBuffer, h->buffer, ctx->cfg.points);
+        ok = endSingleTimeCommands(ctx, ctx->graphicsCommandPool, ctx->graphicsQueue,
+                commandBuffer);
+    }
+    destroyGpugen(ctx);
+    return ok;
+}
+
+static int createTonemapDescriptors(ctx* ctx) {
+    histogramState* h = &ctx->histogram;
+    VkDescriptorSetLayoutBinding binding = {
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &binding,
+    };
+    if (vkCreateDescriptorSetLayout(ctx->logicalDevice, &setLayoutInfo, NULL,
+                &h->setLayout) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create tonemap descriptor set layout\n");
+        return false;
+    }
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+    };
+    if (vkCreateDescriptorPool(ctx->logicalDevice, &poolInfo, NULL,
+                &h->descriptorPool) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create tonemap descriptor pool\n");
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = h->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &h->setLayout,
+    };
+    if (vkAllocateDescriptorSets(ctx->logicalDevice, &allocInfo, &h->descriptorSet)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate tonemap descriptor set\n");
+        return false;
+    }
+
+    VkDescriptorBufferInfo bufferInfo = {
+        .buffer = h->buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = h->descriptorSet,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &bufferInfo,
+    };
+    vkUpdateDescriptorSets(ctx->logicalDevice, 1, &write, 0, NULL);
+    return true;
+}
+
+//fullscreen triangle, no vertex input, otherwise the same fixed function
+//state as the point pipeline
+static int createTonemapPipeline(ctx* ctx) {
+    histogramState* h = &ctx->histogram;
+    VkShaderModule vertexShader, fragmentShader;
+    if (!createShader(ctx->logicalDevice, TONEMAP_VERT_SHADER, &vertexShader)) {
+        fprintf(stderr, "Tonemap vertex shader couldn't be loaded\n");
+        return false;
+    }
+    if (!createShader(ctx->logicalDevice, TONEMAP_FRAG_SHADER, &fragmentShader)) {
+        fprintf(stderr, "Tonemap fragment shader couldn't be loaded\n");
+        vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
+        return false;
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertexShader,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragmentShader,
+            .pName = "main",
+        },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    };
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+    VkDynamicState dynamicStates[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = sizeof(dynamicStates) / sizeof(VkDynamicState),
+        .pDynamicStates = dynamicStates,
+    };
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1,
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+    };
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .sampleShadingEnable = VK_FALSE,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .minSampleShading = 1.0f,
+    };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+                        | VK_COLOR_COMPONENT_G_BIT
+                        | VK_COLOR_COMPONENT_B_BIT
+                        | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = VK_FALSE,
+    };
+    VkPipelineColorBlendStateCreateInfo colorBlending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .attachmentCount = 1,
+        .pAttachments = &colorBlendAttachment,
+    };
+
+    VkPushConstantRange pushRange = {
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(tonemapParams),
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &h->setLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushRange,
+    };
+
+    int ok = vkCreatePipelineLayout(ctx->logicalDevice, &pipelineLayoutInfo, NULL,
+            &h->pipelineLayout) == VK_SUCCESS;
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't create tonemap pipeline layout\n");
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 2,
+        .pStages = shaderStages,
+        .pVertexInputState = &vertexInputInfo,
+        .pInputAssemblyState = &inputAssembly,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizer,
+        .pMultisampleState = &multisampling,
+        .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
+        .layout = h->pipelineLayout,
+        .renderPass = ctx->renderPass,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+    double start = pipelineCacheClock();
+    if (ok && vkCreateGraphicsPipelines(ctx->logicalDevice, ctx->pipelineCache.cache, 1,
+                &pipelineInfo, NULL, &h->pipeline) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create the tonemap pipeline\n");
+        ok = false;
+    }
+    ctx->pipelineCache.createMs += pipelineCacheClock() - start;
+
+    vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
+    vkDestroyShaderModule(ctx->logicalDevice, fragmentShader, NULL);
+    return ok;
+}
+
+int createHistogram(ctx* ctx) {
+    histogramState* h = &ctx->histogram;
+    h->width = ctx->swapchainExtent.width;
+    h->height = ctx->swapchainExtent.height;
+    VkDeviceSize size = gpugenHistogramSize(h->width, h->height);
+
+    if (ctx->cfg.gpuGenerate) {
+        if (!binOnGpu(ctx, size)) {
+            fprintf(stderr, "ERROR: Failed to create histogram\n");
+            return false;
+        }
+    } else if (!createDeviceLocalBuffer(ctx, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                fillHistogram, ctx, &h->buffer, &h->memory)) {
+        fprintf(stderr, "ERROR: Failed to create histogram\n");
+        return false;
+    }
+
+    return createTonemapDescriptors(ctx) && createTonemapPipeline(ctx);
+}
+
+void recordHistogram(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    histogramState* h = &ctx->histogram;
+    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f,}}};
+    VkRenderPassBeginInfo renderPassInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = ctx->renderPass,
+        .framebuffer = ctx->swapchainFramebuffers[imageIndex],
+        .renderArea.offset = {0, 0},
+        .renderArea.extent = ctx->swapchainExtent,
+        .clearValueCount = 1,
+        .pClearValues = &clearColor,
+    };
+
+    tonemapParams params = {
+        .width = h->width,
+        .height = h->height,
+        .targetWidth = ctx->swapchainExtent.width,
+        .targetHeight = ctx->swapchainExtent.height,
+        .gamma = ctx->cfg.gamma,
+    };
+
+    benchBeginFrame(ctx, commandBuffer);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, h->pipeline);
+
+        VkViewport viewport = {
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = (float) ctx->swapchainExtent.width,
+            .height = (float) ctx->swapchainExtent.height,
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f,
+        };
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {
+            .offset = {0, 0},
+            .extent = ctx->swapchainExtent,
+        };
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                h->pipelineLayout, 0, 1, &h->descriptorSet, 0, NULL);
+        vkCmdPushConstants(commandBuffer, h->pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+                0, sizeof(params), &params);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    vkCmdEndRenderPass(commandBuffer);
+    benchEndFrame(ctx, commandBuffer);
+}
+
+void destroyHistogram(ctx* ctx) {
+    histogramState* h = &ctx->histogram;
+    if (h->pipeline) { vkDestroyPipeline(ctx->logicalDevice, h->pipeline, NULL); }
+    if (h->pipelineLayout) { vkDestroyPipelineLayout(ctx->logicalDevice, h->pipelineLayout, NULL); }
+    if (h->descriptorPool) { vkDestroyDescriptorPool(ctx->logicalDevice, h->descriptorPool, NULL); }
+    if (h->setLayout) { vkDestroyDescriptorSetLayout(ctx->logicalDevice, h->setLayout, NULL); }
+    if (h->buffer) { vkDestroyBuffer(ctx->logicalDevice, h->buffer, NULL); }
+    arenaFree(ctx, &h->memory);
+}
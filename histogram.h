@@ -0,0 +1,18 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "vulkan.h"
+
+//--render histogram. the points are binned into a per pixel density
+//histogram (cpu: per thread copies summed at the end, gpu: atomics in the
+//compute generator) and a fullscreen pass tonemaps the log density. memory
+//and fill cost are O(pixels) instead of O(points), and dense regions keep
+//their detail instead of saturating
+
+//bins --points at the current swapchain size and builds the tonemap pipeline.
+//replaces createVertexBuffer
+int createHistogram(ctx* ctx);
+void recordHistogram(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex);
+void destroyHistogram(ctx* ctx);
+
+#endif
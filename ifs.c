@@ -0,0 +1,292 @@
+#include "ifs.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//points run per fit to find the attractor's bounding box
+#define FIT_POINTS (1u << 16)
+
+static void hue(float h, float* rgb) {
+    for (int k = 0; k < 3; k++) {
+        float t = fmodf(h + (2 - k) / 3.0f, 1.0f) * 6.0f;
+        float v = t < 1.0f ? t : (t < 3.0f ? 1.0f : (t < 4.0f ? 4.0f - t : 0.0f));
+        rgb[k] = v;
+    }
+}
+
+static void add_map(ifs* s, float a, float b, float c, float d, float e, float f,
+        float weight) {
+    ifs_map* m = &s->maps[s->numMaps++];
+    *m = (ifs_map) { a, b, c, d, e, f, { 0.0f, 0.0f, 0.0f }, weight };
+}
+
+static void rainbow(ifs* s) {
+    for (uint32_t i = 0; i < s->numMaps; i++) {
+        hue((float) i / s->numMaps, s->maps[i].color);
+    }
+}
+
+//largest singular value of the linear part, < 1 means the map contracts
+static float contraction(const ifs_map* m) {
+    float t = m->a * m->a + m->b * m->b + m->c * m->c + m->d * m->d;
+    float det = m->a * m->d - m->b * m->c;
+    float disc = t * t - 4.0f * det * det;
+    return sqrtf((t + sqrtf(disc > 0.0f ? disc : 0.0f)) * 0.5f);
+}
+
+int ifs_finalize(ifs* s) {
+    if (s->numMaps == 0 || s->numMaps > IFS_MAX_MAPS) {
+        fprintf(stderr, "ERROR: %s: an ifs needs 1 to %u maps, got %u\n", s->name,
+                IFS_MAX_MAPS, s->numMaps);
+        return false;
+    }
+
+    double total = 0.0;
+    float worst = 0.0f;
+    s->uniform = true;
+    for (uint32_t i = 0; i < s->numMaps; i++) {
+        const ifs_map* m = &s->maps[i];
+        if (!(m->weight > 0.0f)) {
+            fprintf(stderr, "ERROR: %s: map %u needs a positive weight\n", s->name, i);
+            return false;
+        }
+        float sigma = contraction(m);
+        if (!(sigma < 1.0f)) {
+            fprintf(stderr, "ERROR: %s: map %u doesn't contract (factor %g)\n", s->name,
+                    i, sigma);
+            return false;
+        }
+        worst = sigma > worst ? sigma : worst;
+        total += m->weight;
+        s->uniform &= m->weight == s->maps[0].weight;
+    }
+
+    //every step shrinks the distance to the attractor by at least worst
+    uint32_t steps = 0;
+    for (float v = 1.0f; v > 1.0f / 16777216.0f && steps < IFS_MAX_BURN_IN; v *= worst) {
+        steps++;
+    }
+    s->burnIn = steps < IFS_MIN_BURN_IN ? IFS_MIN_BURN_IN : steps;
+
+    //vose: columns below average borrow the rest of their mass from one
+    //above average column
+    uint32_t n = s->numMaps;
+    double scaled[IFS_MAX_MAPS];
+    uint32_t small[IFS_MAX_MAPS], large[IFS_MAX_MAPS];
+    uint32_t numSmall = 0, numLarge = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        scaled[i] = s->maps[i].weight / total * n;
+        if (scaled[i] < 1.0) {
+            small[numSmall++] = i;
+        } else {
+            large[numLarge++] = i;
+        }
+    }
+    while (numSmall && numLarge) {
+        uint32_t l = small[--numSmall];
+        uint32_t g = large[--numLarge];
+        s->threshold[l] = (uint32_t) (scaled[l] * 65536.0 + 0.5);
+        s->alias[l] = g;
+        scaled[g] -= 1.0 - scaled[l];
+        if (scaled[g] < 1.0) {
+            small[numSmall++] = g;
+        } else {
+            large[numLarge++] = g;
+        }
+    }
+    //whatever is left is 1 up to rounding
+    while (numLarge) {
+        uint32_t g = large[--numLarge];
+        s->threshold[g] = 65536;
+        s->alias[g] = g;
+    }
+    while (numSmall) {
+        uint32_t l = small[--numSmall];
+        s->threshold[l] = 65536;
+        s->alias[l] = l;
+    }
+    return true;
+}
+
+void ifs_fill_choices(const ifs* s, rng* r, uint8_t* out, size_t n) {
+    rng_fill_choices(r, out, n, s->numMaps);
+    if (s->uniform) {
+        return;
+    }
+
+    //four 16 bit coins per draw
+    for (size_t i = 0; i < n; i += 4) {
+        uint64_t w = rng_next64(r);
+        size_t end = i + 4 < n ? i + 4 : n;
+        for (size_t k = i; k < end; k++) {
+            uint8_t column = out[k];
+            out[k] = (w & 0xffff) < s->threshold[column] ? column : s->alias[column];
+            w >>= 16;
+        }
+    }
+}
+
+//conjugates every map with the transform that takes the attractor's
+//bounding box (y up) onto the view (y down), so the maps produce the fitted
+//attractor directly
+static int fit_to_view(ifs* s) {
+    if (!ifs_finalize(s)) {
+        return false;
+    }
+
+    rng r;
+    rng_seed(&r, RNG_XOSHIRO256SS, 0, 0);
+    uint8_t choices[256];
+    float x = 0.0f, y = 0.0f;
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    for (uint32_t i = 0; i < s->burnIn + FIT_POINTS; i++) {
+        if (i % sizeof(choices) == 0) {
+            ifs_fill_choices(s, &r, choices, sizeof(choices));
+        }
+        const ifs_map* m = &s->maps[choices[i % sizeof(choices)]];
+        float nx = m->a * x + m->b * y + m->e;
+        y = m->c * x + m->d * y + m->f;
+        x = nx;
+        if (i >= s->burnIn) {
+            minX = x < minX ? x : minX;
+            maxX = x > maxX ? x : maxX;
+            minY = y < minY ? y : minY;
+            maxY = y > maxY ? y : maxY;
+        }
+    }
+
+    //uniform scale keeps the shape, a small margin keeps it off the edges
+    float extent = fmaxf(maxX - minX, maxY - minY);
+    float scale = extent > 0.0f ? 1.9f / extent : 1.0f;
+    float cx = (minX + maxX) * 0.5f, cy = (minY + maxY) * 0.5f;
+
+    //T(p) = S (p - c) with S = diag(scale, -scale). for m(p) = A p + t the
+    //conjugate T m T^-1 has linear part S A S^-1 and offset S (A c + t - c)
+    for (uint32_t i = 0; i < s->numMaps; i++) {
+        ifs_map* m = &s->maps[i];
+        float tx = m->a * cx + m->b * cy + m->e - cx;
+        float ty = m->c * cx + m->d * cy + m->f - cy;
+        m->b = -m->b;
+        m->c = -m->c;
+        m->e = scale * tx;
+        m->f = -scale * ty;
+    }
+    return ifs_finalize(s);
+}
+
+static const char* presetNames = "gasket, carpet, vicsek, fern";
+
+const char* ifs_preset_names() {
+    return presetNames;
+}
+
+int ifs_preset(const char* name, ifs* out) {
+    memset(out, 0, sizeof(ifs));
+    snprintf(out->name, sizeof(out->name), "%s", name);
+
+    if (strcmp(name, "gasket") == 0) {
+        //halfway towards one of the corners, each corner owns one channel
+        const float corner[3][2] = { { 0.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+        for (uint32_t i = 0; i < 3; i++) {
+            add_map(out, 0.5f, 0.0f, 0.0f, 0.5f, 0.5f * corner[i][0], 0.5f * corner[i][1],
+                    1.0f);
+            out->maps[i].color[i] = 1.0f;
+        }
+        return ifs_finalize(out);
+    }
+    if (strcmp(name, "carpet") == 0) {
+        //every third of the square but the middle one
+        for (int j = -1; j <= 1; j++) {
+            for (int i = -1; i <= 1; i++) {
+                if (i != 0 || j != 0) {
+                    add_map(out, 1.0f / 3, 0.0f, 0.0f, 1.0f / 3, i * 2.0f / 3, j * 2.0f / 3,
+                            1.0f);
+                }
+            }
+        }
+        rainbow(out);
+        return ifs_finalize(out);
+    }
+    if (strcmp(name, "vicsek") == 0) {
+        //the middle third and its four edge neighbours
+        const int cross[5][2] = { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+        for (uint32_t i = 0; i < 5; i++) {
+            add_map(out, 1.0f / 3, 0.0f, 0.0f, 1.0f / 3, cross[i][0] * 2.0f / 3,
+                    cross[i][1] * 2.0f / 3, 1.0f);
+        }
+        rainbow(out);
+        return ifs_finalize(out);
+    }
+    if (strcmp(name, "fern") == 0) {
+        //barnsley's maps and weights: stem, leaflets, left and right leaf
+        add_map(out, 0.0f, 0.0f, 0.0f, 0.16f, 0.0f, 0.0f, 0.01f);
+        add_map(out, 0.85f, 0.04f, -0.04f, 0.85f, 0.0f, 1.6f, 0.85f);
+        add_map(out, 0.2f, -0.26f, 0.23f, 0.22f, 0.0f, 1.6f, 0.07f);
+        add_map(out, -0.15f, 0.28f, 0.26f, 0.24f, 0.0f, 0.44f, 0.07f);
+        const float greens[4][3] = {
+            { 0.45f, 0.3f, 0.1f }, { 0.2f, 0.8f, 0.2f },
+            { 0.1f, 0.6f, 0.3f }, { 0.5f, 0.9f, 0.1f },
+        };
+        for (uint32_t i = 0; i < 4; i++) {
+            memcpy(out->maps[i].color, greens[i], sizeof(greens[i]));
+        }
+        return fit_to_view(out);
+    }
+
+    fprintf(stderr, "ERROR: unknown fractal '%s', expected %s or a map file\n", name,
+            presetNames);
+    return false;
+}
+
+int ifs_load(const char* path, ifs* out) {
+    memset(out, 0, sizeof(ifs));
+    const char* base = strrchr(path, '/');
+    snprintf(out->name, sizeof(out->name), "%s", base ? base + 1 : path);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: Couldn't open ifs file %s\n", path);
+        return false;
+    }
+
+    char line[512];
+    uint32_t lineNumber = 0;
+    int ok = true;
+    bool anyColor = false;
+    while (ok && fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char* hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        ifs_map m = {};
+        int n = sscanf(line, "%f %f %f %f %f %f %f %f %f %f", &m.a, &m.b, &m.c, &m.d,
+                &m.e, &m.f, &m.weight, &m.color[0], &m.color[1], &m.color[2]);
+        if (n == EOF) {
+            //blank or comment only
+            continue;
+        }
+        if (n != 7 && n != 10) {
+            fprintf(stderr, "ERROR: %s:%u: expected a b c d e f weight [r g b]\n", path,
+                    lineNumber);
+            ok = false;
+        } else if (out->numMaps == IFS_MAX_MAPS) {
+            fprintf(stderr, "ERROR: %s: more than %u maps\n", path, IFS_MAX_MAPS);
+            ok = false;
+        } else {
+            anyColor |= n == 10;
+            out->maps[out->numMaps++] = m;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        return false;
+    }
+    if (!anyColor) {
+        rainbow(out);
+    }
+    return fit_to_view(out);
+}
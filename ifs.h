@@ -0,0 +1,60 @@
+#ifndef IFS_H
+#define IFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rng.h"
+
+//iterated function system: up to IFS_MAX_MAPS affine contractions, each
+//picked with its own probability. the chaos game applies one random map per
+//step and the points it visits fill the attractor. the gasket is the 3 map,
+//equal weight case
+
+//one zmm register or two ymm registers hold a whole column of the tables
+#define IFS_MAX_MAPS 16
+
+//burn in is never shorter than this, so the gasket keeps its old sequence
+#define IFS_MIN_BURN_IN 32
+#define IFS_MAX_BURN_IN 1024
+
+typedef struct ifs_map {
+    //x' = a x + b y + e, y' = c x + d y + f
+    float a, b, c, d, e, f;
+    //the walker's color moves halfway towards this on every step
+    float color[3];
+    float weight;
+} ifs_map;
+
+typedef struct ifs {
+    char name[32];
+    uint32_t numMaps;
+    ifs_map maps[IFS_MAX_MAPS];
+
+    //filled in by ifs_finalize
+    //vose alias table over the normalized weights: the uniformly drawn
+    //column i is kept when a 16 bit coin is below threshold[i] and replaced
+    //by alias[i] otherwise, so a weighted choice is O(1) for any map count
+    uint32_t threshold[IFS_MAX_MAPS];
+    uint8_t alias[IFS_MAX_MAPS];
+    //all weights equal, the coin flip is skipped
+    uint32_t uniform;
+    //steps until any start point is within float precision of the attractor
+    uint32_t burnIn;
+} ifs;
+
+//"gasket", "carpet", "vicsek" or "fern"
+int ifs_preset(const char* name, ifs* out);
+const char* ifs_preset_names();
+
+//one map per line: a b c d e f weight [r g b], # starts a comment. the maps
+//are in y up coordinates and the attractor is scaled to fill the view
+int ifs_load(const char* path, ifs* out);
+
+//validates the maps (contractive, positive weights) and builds the alias
+//table and burn in. call again after changing maps
+int ifs_finalize(ifs* system);
+
+//out[0..n) map indices distributed by the weights
+void ifs_fill_choices(const ifs* system, rng* r, uint8_t* out, size_t n);
+
+#endif
@@ -0,0 +1,375 @@
+#include "image_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//deflate stored blocks hold at most this many bytes
+#define STORED_BLOCK_MAX 65535
+
+typedef struct sink {
+    FILE* file;
+    uint64_t bytes;
+    int ok;
+    //png only: running crc of the current chunk
+    uint32_t crc;
+    uint32_t crcTable[256];
+} sink;
+
+int image_format_from_path(const char* path, image_format* out) {
+    const char* dot = strrchr(path, '.');
+    if (dot == NULL) {
+        return false;
+    }
+    if (strcmp(dot, ".ppm") == 0) {
+        *out = IMAGE_PPM;
+    } else if (strcmp(dot, ".png") == 0) {
+        *out = IMAGE_PNG;
+    } else if (strcmp(dot, ".raw") == 0) {
+        *out = IMAGE_RAW;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int image_sequence_path(const char* path, uint64_t frame, char* out, size_t outSize) {
+    const char* dot = strrchr(path, '.');
+    int stem = dot ? (int) (dot - path) : (int) strlen(path);
+    int n = snprintf(out, outSize, "%.*s_%06llu%s", stem, path,
+            (unsigned long long) frame, dot ? dot : "");
+    return n >= 0 && (size_t) n < outSize;
+}
+
+static void put(sink* s, const void* data, size_t size) {
+    if (s->ok && fwrite(data, 1, size, s->file) != size) {
+        s->ok = false;
+    }
+    s->bytes += size;
+}
+
+static void put_rgb_row(sink* s, uint8_t* row, const uint8_t* rgba, uint32_t width) {
+    for (uint32_t x = 0; x < width; x++) {
+        row[3 * x + 0] = rgba[4 * x + 0];
+        row[3 * x + 1] = rgba[4 * x + 1];
+        row[3 * x + 2] = rgba[4 * x + 2];
+    }
+    put(s, row, (size_t) width * 3);
+}
+
+static void write_ppm(sink* s, uint32_t width, uint32_t height, const uint8_t* rgba,
+        size_t rowPitch, uint8_t* row) {
+    char header[64];
+    int n = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+    put(s, header, n);
+    for (uint32_t y = 0; y < height; y++) {
+        put_rgb_row(s, row, rgba + (size_t) y * rowPitch, width);
+    }
+}
+
+static void write_raw(sink* s, uint32_t width, uint32_t height, const uint8_t* rgba,
+        size_t rowPitch) {
+    for (uint32_t y = 0; y < height; y++) {
+        put(s, rgba + (size_t) y * rowPitch, (size_t) width * 4);
+    }
+}
+
+//png chunks: big endian length, then type and data covered by the crc
+
+static void crc_init(sink* s) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        s->crcTable[i] = c;
+    }
+}
+
+static void put_crc(sink* s, const void* data, size_t size) {
+    const uint8_t* p = data;
+    uint32_t c = s->crc;
+    for (size_t i = 0; i < size; i++) {
+        c = s->crcTable[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    }
+    s->crc = c;
+    put(s, data, size);
+}
+
+static void put_be32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void chunk_begin(sink* s, const char* type, uint32_t length) {
+    uint8_t len[4];
+    put_be32(len, length);
+    put(s, len, 4);
+    s->crc = 0xffffffffu;
+    put_crc(s, type, 4);
+}
+
+static void chunk_end(sink* s) {
+    uint8_t crc[4];
+    put_be32(crc, s->crc ^ 0xffffffffu);
+    put(s, crc, 4);
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t* p, size_t size) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (size > 0) {
+        //largest run before b can overflow 32 bits
+        size_t n = size < 5552 ? size : 5552;
+        size -= n;
+        while (n--) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+//one IDAT chunk per stored deflate block, the first one also carries the
+//zlib header and the last one the adler32 of the uncompressed scanlines
+static void put_stored_block(sink* s, const uint8_t* data, size_t size, int first,
+        int last, uint32_t adler) {
+    chunk_begin(s, "IDAT", (first ? 2 : 0) + 5 + size + (last ? 4 : 0));
+    if (first) {
+        const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+        put_crc(s, zlibHeader, 2);
+    }
+    uint8_t header[5] = {
+        last ? 1 : 0,
+        size & 0xff, size >> 8,
+        ~size & 0xff, (~size >> 8) & 0xff,
+    };
+    put_crc(s, header, 5);
+    put_crc(s, data, size);
+    if (last) {
+        uint8_t trailer[4];
+        put_be32(trailer, adler);
+        put_crc(s, trailer, 4);
+    }
+    chunk_end(s);
+}
+
+static void write_png(sink* s, uint32_t width, uint32_t height, const uint8_t* rgba,
+        size_t rowPitch, uint8_t* row, uint8_t* block) {
+    crc_init(s);
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    put(s, signature, 8);
+
+    uint8_t ihdr[13];
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8;  //bit depth
+    ihdr[9] = 2;  //truecolor
+    ihdr[10] = 0; //deflate
+    ihdr[11] = 0; //adaptive filtering
+    ihdr[12] = 0; //no interlace
+    chunk_begin(s, "IHDR", 13);
+    put_crc(s, ihdr, 13);
+    chunk_end(s);
+
+    //every scanline is filter type 0 followed by the rgb bytes
+    size_t rowSize = 1 + (size_t) width * 3;
+    uint64_t total = (uint64_t) rowSize * height;
+    uint64_t emitted = 0;
+    size_t fill = 0;
+    uint32_t adler = 1;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* src = rgba + (size_t) y * rowPitch;
+        row[0] = 0;
+        for (uint32_t x = 0; x < width; x++) {
+            row[1 + 3 * x + 0] = src[4 * x + 0];
+            row[1 + 3 * x + 1] = src[4 * x + 1];
+            row[1 + 3 * x + 2] = src[4 * x + 2];
+        }
+        adler = adler32(adler, row, rowSize);
+
+        for (size_t done = 0; done < rowSize;) {
+            size_t n = rowSize - done;
+            if (n > STORED_BLOCK_MAX - fill) {
+                n = STORED_BLOCK_MAX - fill;
+            }
+            memcpy(block + fill, row + done, n);
+            fill += n;
+            done += n;
+            if (fill == STORED_BLOCK_MAX) {
+                put_stored_block(s, block, fill, emitted == 0, emitted + fill == total,
+                        adler);
+                emitted += fill;
+                fill = 0;
+            }
+        }
+    }
+    if (fill > 0) {
+        put_stored_block(s, block, fill, emitted == 0, true, adler);
+    }
+
+    chunk_begin(s, "IEND", 0);
+    chunk_end(s);
+}
+
+int write_image(const char* path, image_format format, uint32_t width, uint32_t height,
+        const uint8_t* rgba, size_t rowPitch, uint64_t* bytesWritten) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: Couldn't open %s for writing\n", path);
+        return false;
+    }
+
+    sink* s = malloc(sizeof(sink));
+    uint8_t* row = malloc(1 + (size_t) width * 3);
+    uint8_t* block = format == IMAGE_PNG ? malloc(STORED_BLOCK_MAX) : NULL;
+    if (!s || !row || (format == IMAGE_PNG && !block)) {
+        fprintf(stderr, "ERROR: Couldn't allocate image encoder buffers\n");
+        free(s);
+        free(row);
+        free(block);
+        fclose(file);
+        return false;
+    }
+    s->file = file;
+    s->bytes = 0;
+    s->ok = true;
+
+    switch (format) {
+        case IMAGE_PPM:
+            write_ppm(s, width, height, rgba, rowPitch, row);
+            break;
+        case IMAGE_PNG:
+            write_png(s, width, height, rgba, rowPitch, row, block);
+            break;
+        case IMAGE_RAW:
+            write_raw(s, width, height, rgba, rowPitch);
+            break;
+    }
+
+    int ok = s->ok;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't write %s\n", path);
+    }
+    if (bytesWritten) {
+        *bytesWritten = s->bytes;
+    }
+
+    free(s);
+    free(row);
+    free(block);
+    return ok;
+}
+
+//pwrite may stop short, e.g. on a signal or a full pipe buffer
+static int pwrite_all(int fd, const void* data, size_t size, uint64_t offset) {
+    const uint8_t* p = data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t) offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        size -= (size_t) n;
+        offset += (uint64_t) n;
+    }
+    return true;
+}
+
+int tiled_image_create(tiled_image* image, const char* path, image_format format,
+        uint32_t width, uint32_t height) {
+    if (format != IMAGE_PPM && format != IMAGE_RAW) {
+        fprintf(stderr, "ERROR: tiled images can only be written as .ppm or .raw\n");
+        return false;
+    }
+    image->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (image->fd < 0) {
+        fprintf(stderr, "ERROR: Couldn't open %s for writing\n", path);
+        return false;
+    }
+    image->format = format;
+    image->width = width;
+    image->height = height;
+
+    char header[64];
+    int n = 0;
+    if (format == IMAGE_PPM) {
+        n = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+    }
+    image->headerSize = (uint64_t) n;
+
+    //sized up front so regions can land anywhere, untouched pixels read as black
+    uint64_t pixelBytes = format == IMAGE_PPM ? 3 : 4;
+    uint64_t size = image->headerSize + (uint64_t) width * height * pixelBytes;
+    if (!pwrite_all(image->fd, header, (size_t) n, 0)
+            || ftruncate(image->fd, (off_t) size) != 0) {
+        fprintf(stderr, "ERROR: Couldn't size %s to %llu bytes\n", path,
+                (unsigned long long) size);
+        close(image->fd);
+        image->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+int tiled_image_write(const tiled_image* image, uint32_t x, uint32_t y, uint32_t width,
+        uint32_t height, const uint8_t* rgba, size_t rowPitch, uint64_t* bytesWritten) {
+    uint64_t pixelBytes = image->format == IMAGE_PPM ? 3 : 4;
+    uint8_t* row = NULL;
+    if (image->format == IMAGE_PPM) {
+        row = malloc((size_t) width * 3);
+        if (!row) {
+            fprintf(stderr, "ERROR: Couldn't allocate tile row\n");
+            return false;
+        }
+    }
+
+    int ok = true;
+    for (uint32_t r = 0; ok && r < height; r++) {
+        const uint8_t* src = rgba + (size_t) r * rowPitch;
+        if (row) {
+            for (uint32_t i = 0; i < width; i++) {
+                row[3 * i + 0] = src[4 * i + 0];
+                row[3 * i + 1] = src[4 * i + 1];
+                row[3 * i + 2] = src[4 * i + 2];
+            }
+            src = row;
+        }
+        uint64_t offset = image->headerSize
+            + ((uint64_t) (y + r) * image->width + x) * pixelBytes;
+        ok = pwrite_all(image->fd, src, (size_t) (width * pixelBytes), offset);
+    }
+    free(row);
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't write the %ux%u region at %u,%u\n", width, height,
+                x, y);
+    } else if (bytesWritten) {
+        *bytesWritten = (uint64_t) width * height * pixelBytes;
+    }
+    return ok;
+}
+
+int tiled_image_close(tiled_image* image) {
+    if (image->fd < 0) {
+        return true;
+    }
+    int ok = close(image->fd) == 0;
+    image->fd = -1;
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't close tiled image\n");
+    }
+    return ok;
+}
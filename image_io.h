@@ -0,0 +1,49 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum image_format {
+    IMAGE_PPM = 0,
+    IMAGE_PNG,
+    IMAGE_RAW,
+} image_format;
+
+//picks the format from the extension (.ppm, .png, .raw), false if unknown
+int image_format_from_path(const char* path, image_format* out);
+
+//path with the frame number inserted before the extension when writing a
+//sequence, "out.png" -> "out_000042.png". false if it doesn't fit in out
+int image_sequence_path(const char* path, uint64_t frame, char* out, size_t outSize);
+
+//writes width x height 8 bit rgba pixels, rows rowPitch bytes apart.
+//ppm (P6) and png (8 bit rgb, stored deflate so encoding is a copy) drop the
+//alpha channel, raw is the tightly packed rgba rows without any header.
+//bytesWritten (may be NULL) gets the file size
+int write_image(const char* path, image_format format, uint32_t width, uint32_t height,
+        const uint8_t* rgba, size_t rowPitch, uint64_t* bytesWritten);
+
+//an image too large to hold in memory, written region by region in any
+//order and from any number of threads. only ppm and raw, whose pixels sit
+//at fixed offsets in the file, so each row of a region is a single pwrite
+typedef struct tiled_image {
+    int fd;
+    image_format format;
+    uint32_t width;
+    uint32_t height;
+    //bytes before the first pixel
+    uint64_t headerSize;
+} tiled_image;
+
+//creates path at its final size with the header in place
+int tiled_image_create(tiled_image* image, const char* path, image_format format,
+        uint32_t width, uint32_t height);
+//writes the width x height rgba region at x, y, rows rowPitch bytes apart.
+//regions must not overlap, bytesWritten (may be NULL) gets the bytes of pixel data
+int tiled_image_write(const tiled_image* image, uint32_t x, uint32_t y, uint32_t width,
+        uint32_t height, const uint8_t* rgba, size_t rowPitch, uint64_t* bytesWritten);
+//false if the file couldn't be closed cleanly
+int tiled_image_close(tiled_image* image);
+
+#endif
@@ -0,0 +1,196 @@
+#include "lod.h"
+#include "arena.h"
+#include "camera.h"
+#include "record.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//corners are kept relative to the camera center from the top down. a
+//midpoint of two nearby corners then only rounds relative to their own
+//small offsets, where absolute positions minus the center would lose
+//everything past the 16th digit at every single vertex
+typedef struct lodCorner {
+    double pos[2];
+    float color[3];
+} lodCorner;
+
+typedef struct lodWalk {
+    double zoom;
+    //pixels per unit of normalized device coordinates
+    double scaleX;
+    double scaleY;
+    double pixels;
+    int packed;
+    void* out;
+    uint32_t count;
+} lodWalk;
+
+static lodCorner midpoint(const lodCorner* a, const lodCorner* b) {
+    lodCorner m;
+    for (int k = 0; k < 2; k++) {
+        m.pos[k] = (a->pos[k] + b->pos[k]) * 0.5;
+    }
+    for (int k = 0; k < 3; k++) {
+        m.color[k] = (a->color[k] + b->color[k]) * 0.5f;
+    }
+    return m;
+}
+
+//writes the corner in normalized device coordinates, the draw uses an
+//identity camera. packed positions saturate at the view's edge, which only
+//bends the off screen part of triangles that are a few pixels at most
+static void emit(lodWalk* w, const lodCorner* c, uint32_t index) {
+    float x = (float) (c->pos[0] * w->zoom);
+    float y = (float) (c->pos[1] * w->zoom);
+    if (w->packed) {
+        ((PackedVertex*) w->out)[index] = packVertex(x, y, c->color[0], c->color[1],
+                c->color[2]);
+        return;
+    }
+    Vertex* v = (Vertex*) w->out + index;
+    v->pos[0] = x;
+    v->pos[1] = y;
+    v->color[0] = c->color[0];
+    v->color[1] = c->color[1];
+    v->color[2] = c->color[2];
+}
+
+//false once the slice is full
+static int walk(lodWalk* w, uint32_t level, const lodCorner* a, const lodCorner* b,
+        const lodCorner* c) {
+    double lo[2], hi[2];
+    for (int k = 0; k < 2; k++) {
+        lo[k] = fmin(a->pos[k], fmin(b->pos[k], c->pos[k])) * w->zoom;
+        hi[k] = fmax(a->pos[k], fmax(b->pos[k], c->pos[k])) * w->zoom;
+    }
+    if (hi[0] < -1.0 || lo[0] > 1.0 || hi[1] < -1.0 || lo[1] > 1.0) {
+        return true;
+    }
+
+    double size = fmax((hi[0] - lo[0]) * w->scaleX, (hi[1] - lo[1]) * w->scaleY);
+    if (size <= w->pixels || level == LOD_MAX_LEVEL) {
+        if (w->count == LOD_MAX_TRIANGLES) {
+            return false;
+        }
+        emit(w, a, 3 * w->count + 0);
+        emit(w, b, 3 * w->count + 1);
+        emit(w, c, 3 * w->count + 2);
+        w->count++;
+        return true;
+    }
+
+    lodCorner ab = midpoint(a, b);
+    lodCorner bc = midpoint(b, c);
+    lodCorner ca = midpoint(c, a);
+    return walk(w, level + 1, a, &ab, &ca)
+        && walk(w, level + 1, &ab, b, &bc)
+        && walk(w, level + 1, &ca, &bc, c);
+}
+
+static uint32_t generate(ctx* ctx, void* out, double pixels, int* fits) {
+    cameraState* cam = &ctx->camera;
+    lodWalk w = {
+        .zoom = cam->zoom,
+        .scaleX = ctx->swapchainExtent.width * 0.5,
+        .scaleY = ctx->swapchainExtent.height * 0.5,
+        .pixels = pixels,
+        .packed = ctx->cfg.packedVertices,
+        .out = out,
+        .count = 0,
+    };
+
+    //the gasket preset's corners and colors, see ifs.c
+    lodCorner corners[3] = {
+        { { 0.0, -1.0 }, { 1.0f, 0.0f, 0.0f } },
+        { { 1.0, 1.0 }, { 0.0f, 1.0f, 0.0f } },
+        { { -1.0, 1.0 }, { 0.0f, 0.0f, 1.0f } },
+    };
+    for (int i = 0; i < 3; i++) {
+        corners[i].pos[0] -= cam->center[0];
+        corners[i].pos[1] -= cam->center[1];
+    }
+    *fits = walk(&w, 0, &corners[0], &corners[1], &corners[2]);
+    return w.count;
+}
+
+int createLod(ctx* ctx) {
+    lodState* l = &ctx->lod;
+    l->slotTriangles = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(uint32_t));
+    l->slotVersion = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(uint64_t));
+    if (!l->slotTriangles || !l->slotVersion) {
+        fprintf(stderr, "ERROR: Couldn't allocate lod state\n");
+        return false;
+    }
+    l->pixels = ctx->cfg.lodPixels;
+
+    //rewritten whenever the camera moves and read once per frame, like the
+    //progressive ring. on unified memory it's device local as well
+    VkDeviceSize ringSize = (VkDeviceSize) ctx->MAX_FRAMES_IN_FLIGHT
+        * LOD_MAX_TRIANGLES * 3 * vertexStride(ctx);
+    VkMemoryPropertyFlags props = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (ctx->unifiedMemory) {
+        props |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+    if (!createBuffer(ctx, ringSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, props,
+                &l->ringBuffer, &l->ringMemory)) {
+        fprintf(stderr, "ERROR: Couldn't create lod ring buffer\n");
+        return false;
+    }
+    l->ringMapped = l->ringMemory.mapped;
+
+    //a full slice
+    ctx->benchVertices = 3 * LOD_MAX_TRIANGLES;
+    return true;
+}
+
+int lodUpdate(ctx* ctx) {
+    lodState* l = &ctx->lod;
+    uint32_t slot = ctx->currentFrame;
+    if (l->slotVersion[slot] == ctx->camera.version) {
+        return true;
+    }
+
+    //the slot's previous draw has finished, so its slice is free to overwrite.
+    //views that don't fit at cfg.lodPixels are retried twice as coarse, and
+    //each regeneration first tries half of the last threshold, so the cost
+    //of a frame stays bounded by the slice size and the threshold comes back
+    //down once the view is sparse again
+    void* dst = (uint8_t*) l->ringMapped
+        + (uint64_t) slot * LOD_MAX_TRIANGLES * 3 * vertexStride(ctx);
+    double pixels = fmax(ctx->cfg.lodPixels, l->pixels * 0.5);
+    int fits;
+    uint32_t count = generate(ctx, dst, pixels, &fits);
+    //past the top triangle's own size it's a single triangle, which always
+    //fits. a broken camera never fits, that draws whatever filled the slice
+    double top = ctx->camera.zoom * fmax(ctx->swapchainExtent.width,
+            ctx->swapchainExtent.height);
+    while (!fits && pixels < top) {
+        pixels *= 2.0;
+        count = generate(ctx, dst, pixels, &fits);
+    }
+
+    l->pixels = (float) pixels;
+    l->slotTriangles[slot] = count;
+    l->slotVersion[slot] = ctx->camera.version;
+    return true;
+}
+
+void recordLod(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t part, uint32_t parts) {
+    lodState* l = &ctx->lod;
+    uint32_t slot = ctx->currentFrame;
+    VkDeviceSize offset = (VkDeviceSize) slot * LOD_MAX_TRIANGLES * 3 * vertexStride(ctx);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &l->ringBuffer, &offset);
+    uint32_t first, count;
+    recordShare(l->slotTriangles[slot], part, parts, &first, &count);
+    vkCmdDraw(commandBuffer, 3 * count, 1, 3 * first, 0);
+}
+
+void destroyLod(ctx* ctx) {
+    lodState* l = &ctx->lod;
+    if (l->ringBuffer) { vkDestroyBuffer(ctx->logicalDevice, l->ringBuffer, NULL); }
+    arenaFree(ctx, &l->ringMemory);
+    free(l->slotTriangles);
+    free(l->slotVersion);
+}
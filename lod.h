@@ -0,0 +1,27 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "vulkan.h"
+
+//--render lod: the gasket subdivided only where the camera looks. whenever
+//the view changes the triangle tree is walked again from the top, dropping
+//triangles outside the view and stopping at ones cfg.lodPixels across, so a
+//frame never holds more than what's on screen no matter how deep the zoom
+
+//a slice holds this many triangles, past that the threshold is coarsened
+#define LOD_MAX_TRIANGLES (1u << 18)
+//triangles this deep are 2^-51 across, about as fine as doubles resolve
+#define LOD_MAX_LEVEL 52
+
+//ring buffer of one slice per frame slot. replaces createVertexBuffer
+int createLod(ctx* ctx);
+
+//call once the current slot's fence has signalled, regenerates the slot's
+//slice if the camera moved since it was last written
+int lodUpdate(ctx* ctx);
+//binds the current slot's slice and draws it, inside the render pass
+//part of parts of the slice's triangles, see --record-threads
+void recordLod(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t part, uint32_t parts);
+void destroyLod(ctx* ctx);
+
+#endif
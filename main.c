@@ -1,4 +1,19 @@
 #include "vulkan.h"
+#include "arena.h"
+#include "stream.h"
+#include "upload.h"
+#include "bench.h"
+#include "camera.h"
+#include "chaos.h"
+#include "gpugen.h"
+#include "headless.h"
+#include "histogram.h"
+#include "lod.h"
+#include "pipelinecache.h"
+#include "progressive.h"
+#include "record.h"
+#include "subdivision.h"
+#include "config.h"
 #include <GLFW/glfw3.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -9,10 +24,6 @@
 #include <unistd.h>
 #include <stdlib.h>
 
-const uint32_t NUM_POINTS = 10000;
-
-const uint32_t WIDTH = 800;
-const uint32_t HEIGHT = 600;
 const char* validationLayers[] = {
     "VK_LAYER_KHRONOS_validation",
 };
@@ -30,44 +41,6 @@ const uint32_t NUM_DEVICE_EXTENSIONS =
     const bool enableValidationLayers = true;
 #endif
 
-
-void print_points(Vertex* points, uint32_t NUM_POINTS);
-
-int generate_points(uint32_t numPoints, Vertex* vertices) {
-    float triangle_vertices[3][2] = {
-        {0.0f, -1.0f}, 
-        {1.0f, 1.0f},
-        {-1.0f, 1.0f}, 
-    };
-    float triangle_colors[3][3] = {
-        { 1.0f, 0.0f, 0.0f, },
-        { 0.0f, 1.0f, 0.0f, },
-        { 0.0f, 0.0f, 1.0f, },
-    };
-    Vertex p = {
-        .pos = {0.0f, 0.0f}, 
-        .color ={0.0f, 0.0f, 0.0f}
-    };
-    int j;
-    int rand();
-    Vertex out [numPoints];
-    memset(out, 0, sizeof(Vertex) * numPoints);
-    for (uint32_t k = 0; k < numPoints; k++) {
-        j = rand()%3;
-        p.pos[0] = (p.pos[0] + triangle_vertices[j][0]) / 2;
-        p.pos[1] = (p.pos[1] + triangle_vertices[j][1]) / 2;
-
-        p.color[0] = (p.color[0] + triangle_colors[j][0]) / 2;
-        p.color[1] = (p.color[1] + triangle_colors[j][1]) / 2;
-        p.color[2] = (p.color[2] + triangle_colors[j][2]) / 2;
-
-        out[k] = p;
-    }
-
-    memcpy(vertices, out, sizeof(Vertex) * numPoints);
-    return 1;
-}
-
 bool checkValidationLayerSupport(const char** validationLayers, uint32_t numLayers) {
     uint32_t layerCount;
     vkEnumerateInstanceLayerProperties(&layerCount, NULL);
@@ -98,10 +71,11 @@ bool checkValidationLayerSupport(const char** validationLayers, uint32_t numLaye
     return true;
 }
 
-const char* const* getRequiredExtensions(uint32_t* count) {
+//headless runs never initialise glfw and need no surface extensions
+const char* const* getRequiredExtensions(bool headless, uint32_t* count) {
     uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = 
-        glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    const char** glfwExtensions = headless ? NULL
+        : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
  
     if (!enableValidationLayers) {
         *count = glfwExtensionCount;
@@ -155,10 +129,14 @@ void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT* create
         createInfo->pUserData = NULL;
 }
 
-VkVertexInputBindingDescription getVertexBinding() {
+VkDeviceSize vertexStride(ctx* ctx) {
+    return ctx->cfg.packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+VkVertexInputBindingDescription getVertexBinding(ctx* ctx) {
     VkVertexInputBindingDescription bindingDescription = {
         .binding = 0,
-        .stride = sizeof(Vertex),
+        .stride = vertexStride(ctx),
 
         //input per-vertex, could also be per-instance if doing instance rendering
         .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
@@ -166,7 +144,8 @@ VkVertexInputBindingDescription getVertexBinding() {
     return bindingDescription;
 }
 
-int getAttributeDescriptions(VkVertexInputAttributeDescription* dst, uint32_t* n) {
+int getAttributeDescriptions(ctx* ctx, VkVertexInputAttributeDescription* dst,
+        uint32_t* n) {
     if (!dst && !n) {
         fprintf(stderr, "Must pass a valid pointer\n");
         return false;
@@ -178,15 +157,17 @@ int getAttributeDescriptions(VkVertexInputAttributeDescription* dst, uint32_t* n
         return true;
     }
 
+    //the packed formats are normalized, the shader sees the same floats
+    int packed = ctx->cfg.packedVertices;
     dst[0].binding = 0;
     dst[0].location = 0;
-    dst[0].format = VK_FORMAT_R32G32_SFLOAT;
-    dst[0].offset = offsetof(Vertex, pos);
+    dst[0].format = packed ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32_SFLOAT;
+    dst[0].offset = packed ? offsetof(PackedVertex, pos) : offsetof(Vertex, pos);
 
     dst[1].binding = 0;
     dst[1].location = 1;
-    dst[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    dst[1].offset = offsetof(Vertex, color);
+    dst[1].format = packed ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+    dst[1].offset = packed ? offsetof(PackedVertex, color) : offsetof(Vertex, color);
 
     return true;
 }
@@ -200,13 +181,15 @@ int initWindow(ctx* ctx) {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     //glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    ctx->window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", NULL, NULL);
+    ctx->window = glfwCreateWindow(ctx->cfg.width, ctx->cfg.height, "Vulkan", NULL,
+            NULL);
     glfwSetFramebufferSizeCallback(ctx->window, framebufferResizeCallback);
     glfwSetWindowUserPointer(ctx->window, ctx);
     if (!ctx->window) {
         fprintf(stderr, "ERROR: Couldn't create glfw window\n");
         return 0;
     }
+    installCameraCallbacks(ctx);
     return 1;
 }
 
@@ -222,12 +205,12 @@ int createInstance(ctx* ctx) {
         .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
         .pEngineName = "No Engine",
         .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion = VK_API_VERSION_1_0,
+        .apiVersion = VK_API_VERSION_1_2,
     };
 
     uint32_t extensionCount = 0;
     const char* const* extensions;
-    extensions = getRequiredExtensions(&extensionCount);
+    extensions = getRequiredExtensions(ctx->cfg.headlessOutput != NULL, &extensionCount);
     VkInstanceCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
         .pApplicationInfo = &appInfo,
@@ -299,9 +282,13 @@ void findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface, qfi* indic
             indices->hasGraphics = true;
         }
 
-        //present
+        //present, without a surface (headless) the graphics queue stands in
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        } else {
+            presentSupport = (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        }
         if (presentSupport) {
             indices->presentFamily = i;
             indices->hasPresent = true;
@@ -403,6 +390,10 @@ bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
     qfi indices;
     findQueueFamilies(device, surface, &indices);
 
+    if (surface == VK_NULL_HANDLE) {
+        return qfiComplete(&indices);
+    }
+
     return qfiComplete(&indices) 
         && graphicsCardSupportsExtensions(device, deviceExtensions, NUM_DEVICE_EXTENSIONS)
         && swapchainAdequate(device, surface);
@@ -470,17 +461,30 @@ int createLogicalDevice(ctx* ctx) {
     }
 
     //optional features
+    ctx->bench.hasPipelineStatistics = benchWantsPipelineStatistics(ctx);
     VkPhysicalDeviceFeatures deviceFeatures = {
         .fillModeNonSolid = VK_TRUE,
+        .pipelineStatisticsQuery = ctx->bench.hasPipelineStatistics,
+        //the statistics query stays active across --record-threads secondaries
+        .inheritedQueries = ctx->cfg.recordThreads && ctx->bench.hasPipelineStatistics,
+        .multiDrawIndirect = streamWantsMultiDraw(ctx),
+    };
+
+    //uploads signal a timeline semaphore when the device has them
+    ctx->upload.hasTimeline = uploadSupportsTimeline(ctx->physicalDevice);
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .timelineSemaphore = VK_TRUE,
     };
 
     VkDeviceCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = ctx->upload.hasTimeline ? &timelineFeatures : NULL,
         .pQueueCreateInfos = queueCreateInfos,
         .queueCreateInfoCount = queueFamilyCount,
         .pEnabledFeatures = &deviceFeatures,
-        .enabledExtensionCount = NUM_DEVICE_EXTENSIONS,
-        .ppEnabledExtensionNames = deviceExtensions,
+        .enabledExtensionCount = ctx->surface ? NUM_DEVICE_EXTENSIONS : 0,
+        .ppEnabledExtensionNames = ctx->surface ? deviceExtensions : NULL,
     };
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = NUM_VALIDATION_LAYERS;
@@ -600,6 +604,14 @@ int createSwapchain(ctx* ctx) {
         .oldSwapchain = VK_NULL_HANDLE,
     };
 
+    //progressive mode copies its accumulation image in instead of drawing,
+    //if the surface allows it. otherwise it draws the image in
+    ctx->progressive.copyToSwapchain = ctx->cfg.pointsPerFrame
+        && (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    if (ctx->progressive.copyToSwapchain) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
     qfi indices;
     findQueueFamilies(ctx->physicalDevice, ctx->surface, &indices);
     uint32_t queueFamilyIndices[3] = {};
@@ -637,27 +649,31 @@ int createSwapchain(ctx* ctx) {
 }
 
 
+int createImageView(ctx* ctx, VkImage image, VkFormat format, VkImageView* view) {
+    VkImageViewCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .subresourceRange.baseMipLevel = 0,
+        .subresourceRange.levelCount = 1,
+        .subresourceRange.baseArrayLayer = 0,
+        .subresourceRange.layerCount = 1,
+    };
+
+    return vkCreateImageView(ctx->logicalDevice, &createInfo, NULL, view) == VK_SUCCESS;
+}
+
 int createImageViews(ctx* ctx) {
     ctx->swapchainImageViews = malloc(sizeof(VkImageView) * ctx->numSwapchainImages);
     for (uint32_t i = 0; i < ctx->numSwapchainImages; i++) {
-        VkImageViewCreateInfo createInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .image = ctx->swapchainImages[i],
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = ctx->swapchainImageFormat,
-            .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .subresourceRange.baseMipLevel = 0,
-            .subresourceRange.levelCount = 1,
-            .subresourceRange.baseArrayLayer = 0,
-            .subresourceRange.layerCount = 1,
-        };
-
-        if (vkCreateImageView(ctx->logicalDevice, &createInfo, NULL, 
-                    &ctx->swapchainImageViews[i]) != VK_SUCCESS) {
+        if (!createImageView(ctx, ctx->swapchainImages[i], ctx->swapchainImageFormat,
+                    &ctx->swapchainImageViews[i])) {
             fprintf(stderr, "ERROR: Couldn't create one or more swapchain image views\n");
             return false;
         }
@@ -674,7 +690,9 @@ int createRenderPass(ctx* ctx) {
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        //headless frames are copied out instead of presented
+        .finalLayout = ctx->cfg.headlessOutput ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+            : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
     };
 
     //subpass(es)
@@ -698,13 +716,26 @@ int createRenderPass(ctx* ctx) {
     //this synchronization could also be done in the drawFrame function with semaphores
     //
     //TODO: do some more reading on subpass dependencies and vulkan synchronization
-    VkSubpassDependency dependency = {
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    VkSubpassDependency dependencies[] = {
+        {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = 0,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        },
+        //the readback copies the image right after the pass. the implicit end
+        //dependency only waits on bottom of pipe, so the copy needs this one
+        //to come after the writes and the final layout transition
+        {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        },
     };
 
     //renderpass
@@ -714,8 +745,8 @@ int createRenderPass(ctx* ctx) {
         .pAttachments = &colorAttachment,
         .subpassCount = 1,
         .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency,
+        .dependencyCount = ctx->cfg.headlessOutput ? 2 : 1,
+        .pDependencies = dependencies,
     };
 
     if (vkCreateRenderPass(ctx->logicalDevice, &renderpassInfo, NULL, 
@@ -769,6 +800,14 @@ int createGraphicsPipeline(ctx* ctx) {
         vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
         return false;
     }
+    VkShaderModule instancedShader = VK_NULL_HANDLE;
+    if (ctx->cfg.instanced && !createShader(ctx->logicalDevice, INSTANCED_VERT_SHADER,
+                &instancedShader)) {
+        fprintf(stderr, "Instanced vertex shader couldn't be loaded\n");
+        vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
+        vkDestroyShaderModule(ctx->logicalDevice, fragmentShader, NULL);
+        return false;
+    }
     
     VkPipelineShaderStageCreateInfo vertexShaderStageInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -786,13 +825,18 @@ int createGraphicsPipeline(ctx* ctx) {
         vertexShaderStageInfo,
         fragmentShaderStageInfo,
     };
+    VkPipelineShaderStageCreateInfo instancedShaderStages[] = {
+        vertexShaderStageInfo,
+        fragmentShaderStageInfo,
+    };
+    instancedShaderStages[0].module = instancedShader;
 
-    VkVertexInputBindingDescription bindingDescription = getVertexBinding();
+    VkVertexInputBindingDescription bindingDescription = getVertexBinding(ctx);
 
     uint32_t numAttributeDescriptions;
-    getAttributeDescriptions(NULL, &numAttributeDescriptions);
+    getAttributeDescriptions(ctx, NULL, &numAttributeDescriptions);
     VkVertexInputAttributeDescription attributeDescriptions[numAttributeDescriptions];
-    getAttributeDescriptions(attributeDescriptions, &numAttributeDescriptions);
+    getAttributeDescriptions(ctx, attributeDescriptions, &numAttributeDescriptions);
 
     //Fixed function stages
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
@@ -808,6 +852,8 @@ int createGraphicsPipeline(ctx* ctx) {
         .topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
         .primitiveRestartEnable = VK_FALSE,
     };
+    VkPipelineInputAssemblyStateCreateInfo triangleAssembly = inputAssembly;
+    triangleAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
     //Dynamic viewport set up, defers specifing viewport and scissor till draw 
     //time. If done as a proper fixed-function, a new pipeline would need to be 
@@ -878,18 +924,25 @@ int createGraphicsPipeline(ctx* ctx) {
     };
 
     //pipeline layout is used to define uniform values (push constants) in shaders,
+    //shared by every variant whether its vertex shader reads them or not
+    VkPushConstantRange pushRange = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(vertexParams),
+    };
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = 0,
         .pSetLayouts = NULL, 
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = NULL,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushRange,
     };
     if (vkCreatePipelineLayout(ctx->logicalDevice, &pipelineLayoutInfo, NULL,
                 &ctx->pipelineLayout) != VK_SUCCESS) {
         fprintf(stderr, "ERROR: Couldn't create pipeline layout\n");
         vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
         vkDestroyShaderModule(ctx->logicalDevice, fragmentShader, NULL);
+        vkDestroyShaderModule(ctx->logicalDevice, instancedShader, NULL);
         return false;
     }
 
@@ -915,16 +968,38 @@ int createGraphicsPipeline(ctx* ctx) {
         .basePipelineIndex = -1,
     };
 
-    if (vkCreateGraphicsPipelines(ctx->logicalDevice, VK_NULL_HANDLE, 1, 
-                &pipelineInfo, NULL, &ctx->graphicsPipeline) != VK_SUCCESS) {
-        fprintf(stderr, "ERROR: Couldn't create the graphics pipeline\n");
-        vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
-        vkDestroyShaderModule(ctx->logicalDevice, fragmentShader, NULL);
-        return false;
+    //the variants only differ in topology and vertex shader, the ones the
+    //render mode needs are built in one call
+    VkGraphicsPipelineCreateInfo pipelineInfos[3] = { pipelineInfo };
+    VkPipeline* targets[3] = { &ctx->graphicsPipeline };
+    uint32_t numPipelines = 1;
+    if (ctx->cfg.subdivision || ctx->cfg.lod) {
+        pipelineInfos[numPipelines] = pipelineInfo;
+        pipelineInfos[numPipelines].pInputAssemblyState = &triangleAssembly;
+        targets[numPipelines++] = &ctx->trianglePipeline;
+    }
+    if (ctx->cfg.instanced) {
+        pipelineInfos[numPipelines] = pipelineInfo;
+        pipelineInfos[numPipelines].pStages = instancedShaderStages;
+        pipelineInfos[numPipelines].pInputAssemblyState = &triangleAssembly;
+        targets[numPipelines++] = &ctx->instancedPipeline;
+    }
+
+    VkPipeline pipelines[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+    double start = pipelineCacheClock();
+    VkResult result = vkCreateGraphicsPipelines(ctx->logicalDevice, ctx->pipelineCache.cache,
+            numPipelines, pipelineInfos, NULL, pipelines);
+    ctx->pipelineCache.createMs += pipelineCacheClock() - start;
+    for (uint32_t i = 0; i < numPipelines; i++) {
+        *targets[i] = pipelines[i];
     }
-
     vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
     vkDestroyShaderModule(ctx->logicalDevice, fragmentShader, NULL);
+    vkDestroyShaderModule(ctx->logicalDevice, instancedShader, NULL);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create the graphics pipeline\n");
+        return false;
+    }
     return true;
 }
 
@@ -994,7 +1069,7 @@ int findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties,
     VkPhysicalDeviceMemoryProperties memProps;
     vkGetPhysicalDeviceMemoryProperties(device, &memProps);
     for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
-        if (typeFilter & (i << i) && (memProps.memoryTypes[i].propertyFlags 
+        if (typeFilter & (1u << i) && (memProps.memoryTypes[i].propertyFlags 
                     & properties) == properties) {
             *out = i;
             return true;
@@ -1005,8 +1080,35 @@ int findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties,
     return false;
 }
 
+//true when the cpu can write the device's main memory directly: integrated
+//gpus, software rasterizers like lavapipe, full size resizable BAR. a small
+//host visible window (256MB BAR) on a bigger vram heap doesn't count
+bool hasUnifiedMemory(VkPhysicalDevice device) {
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(device, &memProps);
+
+    VkDeviceSize largestDeviceHeap = 0;
+    for (uint32_t i = 0; i < memProps.memoryHeapCount; i++) {
+        if (memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT
+                && memProps.memoryHeaps[i].size > largestDeviceHeap) {
+            largestDeviceHeap = memProps.memoryHeaps[i].size;
+        }
+    }
+
+    VkMemoryPropertyFlags uma = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT 
+        | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+        uint32_t heap = memProps.memoryTypes[i].heapIndex;
+        if ((memProps.memoryTypes[i].propertyFlags & uma) == uma 
+                && memProps.memoryHeaps[heap].size >= largestDeviceHeap) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int createBuffer(ctx* ctx, VkDeviceSize size, VkBufferUsageFlags usage, 
-        VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory) {
+        VkMemoryPropertyFlags properties, VkBuffer* buffer, memAlloc* bufferMemory) {
 
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -1023,53 +1125,45 @@ int createBuffer(ctx* ctx, VkDeviceSize size, VkBufferUsageFlags usage,
     VkMemoryRequirements memReqs;
     vkGetBufferMemoryRequirements(ctx->logicalDevice, *buffer, &memReqs);
 
-    uint32_t memType;
-    if (!findMemoryType(memReqs.memoryTypeBits, properties, ctx->physicalDevice, 
-                &memType)) {
-        return false;
-    }
-
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = memType,
-    };
-
-    if (vkAllocateMemory(ctx->logicalDevice, &allocInfo, NULL, bufferMemory)
-            != VK_SUCCESS) {
-        fprintf(stderr, "ERROR: Couldn't allocate vertex buffer memory\n");
+    if (!arenaAlloc(ctx, &memReqs, properties, true, bufferMemory)) {
+        fprintf(stderr, "ERROR: Couldn't allocate buffer memory\n");
+        vkDestroyBuffer(ctx->logicalDevice, *buffer, NULL);
+        *buffer = VK_NULL_HANDLE;
         return false;
     }
-    vkBindBufferMemory(ctx->logicalDevice, *buffer, *bufferMemory, 0);
+    vkBindBufferMemory(ctx->logicalDevice, *buffer, bufferMemory->memory,
+            bufferMemory->offset);
 
     return true;
 }
 
-void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, 
-        ctx* ctx) {
+//one-shot command buffer from pool, submitted and waited on by
+//endSingleTimeCommands. fine for setup work, not for per frame work
+VkCommandBuffer beginSingleTimeCommands(ctx* ctx, VkCommandPool pool) {
     VkCommandBufferAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandPool = ctx->transferCommandPool,
+        .commandPool = pool,
         .commandBufferCount = 1,
     };
 
     VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, &commandBuffer);
+    if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, &commandBuffer) 
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate a one-shot command buffer\n");
+        return VK_NULL_HANDLE;
+    }
 
     VkCommandBufferBeginInfo beginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
-
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
-        VkBufferCopy copyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = size,
-        };
+    return commandBuffer;
+}
 
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+int endSingleTimeCommands(ctx* ctx, VkCommandPool pool, VkQueue queue, 
+        VkCommandBuffer commandBuffer) {
     vkEndCommandBuffer(commandBuffer);
 
     VkSubmitInfo submitInfo = {
@@ -1079,21 +1173,75 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
     };
 
     //could also use a fence to wait instead, (better for batches of commands)
-    vkQueueSubmit(ctx->transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(ctx->transferQueue);
-    vkFreeCommandBuffers(ctx->logicalDevice, ctx->transferCommandPool, 1, 
-            &commandBuffer);
+    int ok = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS;
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't submit one-shot command buffer\n");
+    }
+    vkQueueWaitIdle(queue);
+    vkFreeCommandBuffers(ctx->logicalDevice, pool, 1, &commandBuffer);
+    return ok;
 }
 
-int createVertexBuffer(ctx* ctx, Vertex* vertices) {
-    VkDeviceSize bufferSize = sizeof(Vertex) * NUM_POINTS;
+//2D, single mip, optimal tiling, device local
+int createImage(ctx* ctx, uint32_t width, uint32_t height, VkFormat format, 
+        VkImageUsageFlags usage, VkImage* image, memAlloc* imageMemory) {
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = { width, height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    if (vkCreateImage(ctx->logicalDevice, &imageInfo, NULL, image) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create image\n");
+        return false;
+    }
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(ctx->logicalDevice, *image, &memReqs);
+
+    if (!arenaAlloc(ctx, &memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, imageMemory)) {
+        fprintf(stderr, "ERROR: Couldn't allocate image memory\n");
+        vkDestroyImage(ctx->logicalDevice, *image, NULL);
+        *image = VK_NULL_HANDLE;
+        return false;
+    }
+    vkBindImageMemory(ctx->logicalDevice, *image, imageMemory->memory, imageMemory->offset);
+
+    return true;
+}
+
+//creates a DEVICE_LOCAL buffer whose contents are produced by fill. on unified
+//memory devices fill writes the buffer directly, otherwise it writes a
+//temporary staging buffer that is then copied over on the transfer queue
+int createDeviceLocalBuffer(ctx* ctx, VkDeviceSize size, VkBufferUsageFlags usage,
+        uploadFillFn fill, void* user, VkBuffer* buffer, memAlloc* bufferMemory) {
+    if (ctx->unifiedMemory) {
+        if (!createBuffer(
+                ctx,
+                size,
+                usage,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                buffer,
+                bufferMemory)) {
+            return false;
+        }
+        return fill(bufferMemory->mapped, size, user);
+    }
 
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    
+    memAlloc stagingBufferMemory;
     if (!createBuffer(
             ctx, 
-            bufferSize, 
+            size, 
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
             &stagingBuffer, 
@@ -1102,59 +1250,195 @@ int createVertexBuffer(ctx* ctx, Vertex* vertices) {
         return false;
     }
 
-    void* data;
-    vkMapMemory(ctx->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices, bufferSize);
-    vkUnmapMemory(ctx->logicalDevice, stagingBufferMemory);
+    int filled = fill(stagingBufferMemory.mapped, size, user);
 
-    if (!createBuffer(
+    if (!filled || !createBuffer(
             ctx,
-            bufferSize, 
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-            &ctx->vertexBuffer,
-            &ctx->vertexBufferMemory)) {
-        fprintf(stderr, "ERROR: Failed to create vertex buffer\n");
+            size, 
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, 
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+            buffer,
+            bufferMemory)) {
+        vkDestroyBuffer(ctx->logicalDevice, stagingBuffer, NULL);
+        arenaFree(ctx, &stagingBufferMemory);
+        return false;
+    }
+
+    //the copy goes out with the next flush, the first frame waits for it
+    if (!uploadCopy(ctx, stagingBuffer, 0, *buffer, 0, size, usage)) {
+        vkDestroyBuffer(ctx->logicalDevice, stagingBuffer, NULL);
+        arenaFree(ctx, &stagingBufferMemory);
         return false;
     }
+    return uploadRetire(ctx, stagingBuffer, &stagingBufferMemory);
+}
 
-    copyBuffer(stagingBuffer, ctx->vertexBuffer, bufferSize, ctx);
-    vkDestroyBuffer(ctx->logicalDevice, stagingBuffer, NULL);
-    vkFreeMemory(ctx->logicalDevice, stagingBufferMemory, NULL);
+//the generator writes straight into the mapped memory, so the points are
+//produced exactly once and never touch the stack or a host copy
+int fillPoints(void* dst, VkDeviceSize size, void* user) {
+    ctx* ctx = user;
+    if (ctx->cfg.loadPoints && ctx->cfg.packedVertices) {
+        return point_file_read_packed(&ctx->pointFile, 0, ctx->cfg.points, dst);
+    } else if (ctx->cfg.loadPoints) {
+        return point_file_read(&ctx->pointFile, 0, ctx->cfg.points, dst);
+    }
+    if (!generate_points(ctx->cfg.points, dst, &ctx->cfg)) {
+        fprintf(stderr, "ERROR: Couldn't generate points\n");
+        return false;
+    }
     return true;
 }
 
-int createCommandBuffers(ctx* ctx) {
-    ctx->commandBuffers = malloc(sizeof(VkCommandBuffer) * ctx->MAX_FRAMES_IN_FLIGHT);
-    VkCommandBufferAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = ctx->graphicsCommandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = ctx->MAX_FRAMES_IN_FLIGHT,
-    };
+int fillSubdivisionVertices(void* dst, VkDeviceSize size, void* user) {
+    ctx* ctx = user;
+    subdivide_gasket(ctx->cfg.subdivisionDepth, ctx->cfg.packedVertices, dst, NULL);
+    return true;
+}
 
-    if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, ctx->commandBuffers) 
-            != VK_SUCCESS) {
-        fprintf(stderr, "ERROR: Couldn't allocate command buffers\n");
+int fillSubdivisionIndices(void* dst, VkDeviceSize size, void* user) {
+    ctx* ctx = user;
+    subdivide_gasket(ctx->cfg.subdivisionDepth, ctx->cfg.packedVertices, NULL, dst);
+    return true;
+}
+
+//vertices and indices are generated in two passes, each straight into its
+//own mapped buffer
+int createSubdivisionBuffers(ctx* ctx) {
+    uint32_t depth = ctx->cfg.subdivisionDepth;
+    uint32_t numVertices = subdivision_vertex_count(depth);
+    ctx->numIndices = subdivision_index_count(depth);
+    if (!createDeviceLocalBuffer(ctx, vertexStride(ctx) * numVertices,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, fillSubdivisionVertices, ctx,
+                &ctx->vertexBuffer, &ctx->vertexBufferMemory)
+            || !createDeviceLocalBuffer(ctx, sizeof(uint32_t) * (VkDeviceSize) ctx->numIndices,
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT, fillSubdivisionIndices, ctx,
+                &ctx->indexBuffer, &ctx->indexBufferMemory)) {
+        fprintf(stderr, "ERROR: Failed to create subdivision buffers\n");
         return false;
     }
 
+    //every index is one input vertex
+    ctx->benchVertices = ctx->numIndices;
+    fprintf(stdout, "subdivision: depth %u, %u triangles, %u vertices\n", depth,
+            ctx->numIndices / 3, numVertices);
     return true;
 }
 
-int recordCommandBuffer(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    VkCommandBufferBeginInfo beginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = 0,
-        .pInheritanceInfo = NULL,
-    };
+//just the depth 0 triangle, the vertex shader places every instance
+int fillInstancedTriangle(void* dst, VkDeviceSize size, void* user) {
+    ctx* ctx = user;
+    subdivide_gasket(0, ctx->cfg.packedVertices, dst, NULL);
+    return true;
+}
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-        fprintf(stderr, "ERROR: Couldn't begin recording command buffer %d\n", 
-                imageIndex);
+int createInstancedBuffer(ctx* ctx) {
+    if (!createDeviceLocalBuffer(ctx, vertexStride(ctx) * subdivision_vertex_count(0),
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, fillInstancedTriangle, ctx,
+                &ctx->vertexBuffer, &ctx->vertexBufferMemory)) {
+        fprintf(stderr, "ERROR: Failed to create vertex buffer\n");
+        return false;
+    }
+
+    ctx->numInstances = 1;
+    for (uint32_t i = 0; i < ctx->cfg.subdivisionDepth; i++) {
+        ctx->numInstances *= 3;
+    }
+    //3 input vertices per instance
+    ctx->benchVertices = 3 * ctx->numInstances;
+    fprintf(stdout, "instanced: depth %u, %u instances of one triangle\n",
+            ctx->cfg.subdivisionDepth, ctx->numInstances);
+    return true;
+}
+
+int createVertexBuffer(ctx* ctx) {
+    if (ctx->cfg.gpuGenerate) {
+        return createGpuVertexBuffer(ctx);
+    }
+    if (ctx->cfg.subdivision) {
+        return createSubdivisionBuffers(ctx);
+    }
+    if (ctx->cfg.instanced) {
+        return createInstancedBuffer(ctx);
+    }
+    if (ctx->cfg.residentPoints) {
+        return createStream(ctx);
+    }
+
+    VkDeviceSize bufferSize = vertexStride(ctx) * ctx->cfg.points;
+    if (!createDeviceLocalBuffer(ctx, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                fillPoints, ctx, &ctx->vertexBuffer, &ctx->vertexBufferMemory)) {
+        fprintf(stderr, "ERROR: Failed to create vertex buffer\n");
         return false;
     }
+    return true;
+}
+
+//inline in the frame's render pass, or a worker's secondary with --record-threads.
+//a secondary inherits no state, every part sets all of it
+void recordPointSetDraws(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t part,
+        uint32_t parts) {
+    VkPipeline pipeline = ctx->cfg.subdivision || ctx->cfg.lod ? ctx->trianglePipeline
+        : ctx->cfg.instanced ? ctx->instancedPipeline : ctx->graphicsPipeline;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    //this is done here because the graphics pipeline specifies dynamic viewport
+    VkViewport viewport = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = (float) ctx->swapchainExtent.width,
+        .height = (float) ctx->swapchainExtent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
+    //also dynamic scissor
+    VkRect2D scissor = {
+        .offset = {0, 0},
+        .extent = ctx->swapchainExtent,
+    };
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    //the lod slice is already in view space
+    vertexParams params = ctx->cfg.lod ? identityVertexParams(ctx)
+        : cameraVertexParams(ctx);
+    vkCmdPushConstants(commandBuffer, ctx->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+            0, sizeof(params), &params);
+
+    //one instance of the point set, see `make bench` for the overdraw check
+    if (ctx->cfg.lod) {
+        recordLod(ctx, commandBuffer, part, parts);
+        return;
+    }
+    if (ctx->cfg.residentPoints) {
+        recordStream(ctx, commandBuffer, part, parts);
+        return;
+    }
+
+    VkBuffer vertexBuffers[] = { ctx->vertexBuffer };
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+    uint32_t first, count;
+    if (ctx->cfg.subdivision) {
+        recordShare(ctx->numIndices / 3, part, parts, &first, &count);
+        vkCmdBindIndexBuffer(commandBuffer, ctx->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(commandBuffer, 3 * count, 1, 3 * first, 0, 0);
+    } else if (ctx->cfg.instanced) {
+        recordShare(ctx->numInstances, part, parts, &first, &count);
+        vkCmdDraw(commandBuffer, 3, count, 0, first);
+    } else if (ctx->cfg.gpuGenerate) {
+        //one draw whose count only the gpu knows, it can't be split
+        if (part == 0) {
+            recordGpugenDraw(ctx, commandBuffer, 0);
+        }
+    } else {
+        recordShare(ctx->cfg.points, part, parts, &first, &count);
+        vkCmdDraw(commandBuffer, count, 1, first, 0);
+    }
+}
+
+int recordPointSet(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
     VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f,}}};
     VkRenderPassBeginInfo renderPassInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
@@ -1166,35 +1450,42 @@ int recordCommandBuffer(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageI
         .pClearValues = &clearColor,
     };
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-                ctx->graphicsPipeline);
-
-        //this is done here because the graphics pipeline specifies dynamic viewport
-        VkViewport viewport = {
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = (float) ctx->swapchainExtent.width,
-            .height = (float) ctx->swapchainExtent.height,
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f,
-        };
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    int ok = true;
+    benchBeginFrame(ctx, commandBuffer);
+    if (ctx->record.numWorkers) {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            ok = recordSecondaries(ctx, commandBuffer, imageIndex);
+        vkCmdEndRenderPass(commandBuffer);
+    } else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            recordPointSetDraws(ctx, commandBuffer, 0, 1);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+    benchEndFrame(ctx, commandBuffer);
+    return ok;
+}
 
-        //also dynamic scissor
-        VkRect2D scissor = {
-            .offset = {0, 0},
-            .extent = ctx->swapchainExtent,
-        };
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+int recordCommandBuffer(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = 0,
+        .pInheritanceInfo = NULL,
+    };
 
-        VkBuffer vertexBuffers[] = { ctx->vertexBuffer };
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't begin recording command buffer %d\n", 
+                imageIndex);
+        return false;
+    }
 
-        vkCmdDraw(commandBuffer, NUM_POINTS, NUM_POINTS, 0, 0);
-        //vkCmdDrawIndexed(commandBuffer, numIndices, 1, 0, 0, 0);
-    vkCmdEndRenderPass(commandBuffer);
+    if (ctx->cfg.histogram) {
+        recordHistogram(ctx, commandBuffer, imageIndex);
+    } else if (ctx->cfg.pointsPerFrame) {
+        recordProgressive(ctx, commandBuffer, imageIndex);
+    } else if (!recordPointSet(ctx, commandBuffer, imageIndex)) {
+        return false;
+    }
     
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         fprintf(stderr, "ERROR: Couldn't record command buffer %d\n", imageIndex);
@@ -1233,24 +1524,50 @@ int createSyncObjects(ctx* ctx) {
     return true;
 }
 
-int initVulkan(ctx* ctx, Vertex* vertices) {
-    ctx->MAX_FRAMES_IN_FLIGHT = 2;
+int initVulkan(ctx* ctx) {
+    ctx->MAX_FRAMES_IN_FLIGHT = ctx->cfg.framesInFlight;
     ctx->currentFrame = 0;
     ctx->framebufferResized = false;
+    initCamera(ctx);
     if (!createInstance(ctx)) { return false; }
     if (!setupDebugMessenger(ctx)) { return false; }
-    if (!createSurface(ctx)) { return false; }
+    if (!ctx->cfg.headlessOutput && !createSurface(ctx)) { return false; }
     if (!pickPhysicalDevice(ctx)) { return false; }
+    ctx->unifiedMemory = hasUnifiedMemory(ctx->physicalDevice);
+    initArena(ctx);
     if (!createLogicalDevice(ctx)) { return false; }
-    if (!createSwapchain(ctx)) { return false; }
+    if (!createPipelineCache(ctx)) { return false; }
+    if (ctx->cfg.headlessOutput) {
+        if (!createOffscreenTarget(ctx)) { return false; }
+    } else {
+        if (!createSwapchain(ctx)) { return false; }
+    }
     if (!createImageViews(ctx)) { return false; }
     if (!createRenderPass(ctx)) { return false; }
     if (!createGraphicsPipeline(ctx)) { return false; }
     if (!createFramebuffers(ctx)) { return false; }
     if (!createCommandPools(ctx)) { return false; }
-    if (!createVertexBuffer(ctx, vertices)) { return false; }
-    if (!createCommandBuffers(ctx)) { return false; }
+    if (!createUploader(ctx)) { return false; }
+    ctx->benchVertices = ctx->cfg.points;
+    if (ctx->cfg.histogram) {
+        if (!createHistogram(ctx)) { return false; }
+    } else if (ctx->cfg.pointsPerFrame) {
+        if (!createProgressive(ctx)) { return false; }
+    } else if (ctx->cfg.lod) {
+        if (!createLod(ctx)) { return false; }
+    } else {
+        if (!createVertexBuffer(ctx)) { return false; }
+    }
+    if (!createRecording(ctx)) { return false; }
+    if (ctx->cfg.headlessOutput && !createReadback(ctx)) { return false; }
     if (!createSyncObjects(ctx)) { return false; }
+    if (!createBenchQueries(ctx)) { return false; }
+    //every pipeline and long lived buffer exists by now, the setup copies go
+    //out as one submission
+    if (!uploadFlush(ctx)) { return false; }
+    savePipelineCache(ctx);
+    arenaReport(ctx);
+    uploadReport(ctx);
     return true;
 }
 
@@ -1261,7 +1578,7 @@ int cleanupSwapchain(ctx* ctx) {
     for (uint32_t i = 0; i < ctx->numSwapchainImages; i++) {
             vkDestroyImageView(ctx->logicalDevice, ctx->swapchainImageViews[i], NULL);
     }
-        vkDestroySwapchainKHR(ctx->logicalDevice, ctx->swapchain, NULL);
+    if (ctx->swapchain) { vkDestroySwapchainKHR(ctx->logicalDevice, ctx->swapchain, NULL); }
     return true;
 }
 
@@ -1289,6 +1606,16 @@ int recreateSwapchain(ctx* ctx) {
         fprintf(stderr, "ERROR: FAILED TO RECREATE FRAMEBUFFERS\n");
         return false;
     }
+    if (ctx->cfg.pointsPerFrame && !recreateProgressiveTarget(ctx)) {
+        fprintf(stderr, "ERROR: FAILED TO RECREATE ACCUMULATION IMAGE\n");
+        return false;
+    }
+    if (!recreateRecording(ctx)) {
+        fprintf(stderr, "ERROR: FAILED TO RECREATE COMMAND BUFFERS\n");
+        return false;
+    }
+    //lod's triangle sizes are in pixels of the old extent
+    ctx->camera.version++;
 
     return true;
 }
@@ -1297,6 +1624,8 @@ int drawFrame(ctx* ctx) {
     //stall host until gpu has signalled that the render is finished
     vkWaitForFences(ctx->logicalDevice, 1, &ctx->inFlightFences[ctx->currentFrame], 
             VK_TRUE, UINT64_MAX);
+    benchCollect(ctx);
+    uploadCollect(ctx);
 
     uint32_t imageIndex;
     VkResult res = vkAcquireNextImageKHR(ctx->logicalDevice, ctx->swapchain, UINT64_MAX, 
@@ -1309,28 +1638,62 @@ int drawFrame(ctx* ctx) {
         return false;
     }
 
+    if (ctx->cfg.pointsPerFrame && !progressiveNextBatch(ctx)) {
+        return false;
+    }
+    if (ctx->cfg.lod && !lodUpdate(ctx)) {
+        return false;
+    }
+    if (ctx->cfg.residentPoints && !streamUpdate(ctx)) {
+        return false;
+    }
+
     //return fence to unsignaled state after recieving signal
     vkResetFences(ctx->logicalDevice, 1, &ctx->inFlightFences[ctx->currentFrame]);
 
-    vkResetCommandBuffer(ctx->commandBuffers[ctx->currentFrame], 0);
-    recordCommandBuffer(ctx, ctx->commandBuffers[ctx->currentFrame], imageIndex);
+    VkCommandBuffer frame = frameCommandBuffer(ctx, imageIndex);
+    if (frame == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    uploadWait upload;
+    if (!uploadGraphicsWait(ctx, ctx->currentFrame, &upload)) {
+        return false;
+    }
 
     VkSemaphore waitSemaphores[] = {
         ctx->imageAvailableSemaphores[ctx->currentFrame],
+        upload.semaphore,
     };
+    //progressive mode may write the swapchain image with a copy
     VkPipelineStageFlags waitStages[] = {
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        ctx->progressive.copyToSwapchain ? VK_PIPELINE_STAGE_TRANSFER_BIT
+            : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        upload.stages,
+    };
+    //the binary semaphore's value is ignored
+    uint64_t waitValues[] = { 0, upload.value };
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 2,
+        .pWaitSemaphoreValues = waitValues,
+    };
+    VkCommandBuffer commandBuffers[] = {
+        upload.acquire,
+        frame,
     };
+    uint32_t firstCommandBuffer = upload.acquire ? 0 : 1;
     VkSemaphore signalSemaphores[] = {
         ctx->renderFinishedSemaphores[ctx->currentFrame],
     };
     VkSubmitInfo submitInfo = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
+        .pNext = upload.semaphore ? &timelineInfo : NULL,
+        .waitSemaphoreCount = upload.semaphore ? 2 : 1,
         .pWaitSemaphores = waitSemaphores,
         .pWaitDstStageMask = waitStages,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &ctx->commandBuffers[ctx->currentFrame],
+        .commandBufferCount = 2 - firstCommandBuffer,
+        .pCommandBuffers = &commandBuffers[firstCommandBuffer],
         .signalSemaphoreCount = 1,
         .pSignalSemaphores = signalSemaphores,
     };
@@ -1340,6 +1703,7 @@ int drawFrame(ctx* ctx) {
         fprintf(stderr, "ERROR: Couldn't submit draw command buffer %d\n", imageIndex);
         return false;
     }
+    benchSubmitted(ctx);
 
     VkSwapchainKHR swapchains[] = { ctx->swapchain };
     VkPresentInfoKHR presentInfo = {
@@ -1369,13 +1733,19 @@ int drawFrame(ctx* ctx) {
 }
 
 int mainLoop(ctx* ctx) {
-    while (!glfwWindowShouldClose(ctx->window)) {
+    while (!glfwWindowShouldClose(ctx->window) && !benchDone(ctx)) {
         glfwPollEvents();
         if (!drawFrame(ctx)) {
             return false;
         }
     }
     vkDeviceWaitIdle(ctx->logicalDevice);
+
+    //frames still in flight when the loop ended
+    for (uint32_t i = 0; i < ctx->MAX_FRAMES_IN_FLIGHT; i++) {
+        ctx->currentFrame = (ctx->currentFrame + 1) % ctx->MAX_FRAMES_IN_FLIGHT;
+        benchCollect(ctx);
+    }
     return true;
 }
 
@@ -1392,16 +1762,32 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 
 int cleanup(ctx* ctx) {
     cleanupSwapchain(ctx);
+    destroyHeadless(ctx);
     for (uint32_t i = 0; i < ctx->MAX_FRAMES_IN_FLIGHT; i++) {
         if (ctx->imageAvailableSemaphores[i]) { vkDestroySemaphore(ctx->logicalDevice, ctx->imageAvailableSemaphores[i], NULL); }
         if (ctx->inFlightFences[i]) { vkDestroyFence(ctx->logicalDevice, ctx->inFlightFences[i], NULL); }
         if (ctx->renderFinishedSemaphores[i]) { vkDestroySemaphore(ctx->logicalDevice, ctx->renderFinishedSemaphores[i], NULL); }
     }
+    destroyBenchQueries(ctx);
+    point_file_close(&ctx->pointFile);
+    destroyProgressive(ctx);
+    destroyHistogram(ctx);
+    destroyLod(ctx);
+    destroyStream(ctx);
+    destroyGpugen(ctx);
     if (ctx->vertexBuffer) { vkDestroyBuffer(ctx->logicalDevice, ctx->vertexBuffer, NULL); }
-    if (ctx->vertexBufferMemory) { vkFreeMemory(ctx->logicalDevice, ctx->vertexBufferMemory, NULL); }
+    arenaFree(ctx, &ctx->vertexBufferMemory);
+    if (ctx->indexBuffer) { vkDestroyBuffer(ctx->logicalDevice, ctx->indexBuffer, NULL); }
+    arenaFree(ctx, &ctx->indexBufferMemory);
+    destroyRecording(ctx);
     if (ctx->graphicsCommandPool) { vkDestroyCommandPool(ctx->logicalDevice, ctx->graphicsCommandPool, NULL); }
     if (ctx->transferCommandPool) { vkDestroyCommandPool(ctx->logicalDevice, ctx->transferCommandPool, NULL); }
     if (ctx->graphicsPipeline) { vkDestroyPipeline(ctx->logicalDevice, ctx->graphicsPipeline, NULL); }
+    if (ctx->trianglePipeline) { vkDestroyPipeline(ctx->logicalDevice, ctx->trianglePipeline, NULL); }
+    if (ctx->instancedPipeline) { vkDestroyPipeline(ctx->logicalDevice, ctx->instancedPipeline, NULL); }
+    destroyPipelineCache(ctx);
+    destroyUploader(ctx);
+    destroyArena(ctx);
     if (ctx->pipelineLayout) { vkDestroyPipelineLayout(ctx->logicalDevice, ctx->pipelineLayout, NULL); }
     if (ctx->renderPass) { vkDestroyRenderPass(ctx->logicalDevice, ctx->renderPass, NULL); }
     if (ctx->logicalDevice) { vkDestroyDevice(ctx->logicalDevice, NULL); }
@@ -1414,7 +1800,6 @@ int cleanup(ctx* ctx) {
     if (ctx->swapchainImages) { free(ctx->swapchainImages); }
     if (ctx->swapchainImageViews) { free(ctx->swapchainImageViews); }
     if (ctx->swapchainFramebuffers) { free(ctx->swapchainFramebuffers); }
-    if (ctx->commandBuffers) { free(ctx->commandBuffers); }
     if (ctx->imageAvailableSemaphores) { free(ctx->imageAvailableSemaphores); }
     if (ctx->renderFinishedSemaphores) { free(ctx->renderFinishedSemaphores); }
     if (ctx->inFlightFences) { free(ctx->inFlightFences); }
@@ -1422,39 +1807,78 @@ int cleanup(ctx* ctx) {
     return 1;
 }
 
-void print_points(Vertex* points, uint32_t NUM_POINTS) {
-    Vertex* p = points;
-    for (uint32_t i = 0; i < NUM_POINTS; i++) {
-        fprintf(stdout, "%f, %f\n", p->pos[0], p->pos[1]);
-        p++;
+int main(int argc, char** argv) {
+    config cfg;
+    if (!parse_args(argc, argv, &cfg)) {
+        free_config(&cfg);
+        return EXIT_FAILURE;
+    }
+    //printed so any run can be reproduced with --seed
+    fprintf(stdout, "seed: %llu (%s)\n", (unsigned long long) cfg.seed,
+            rng_kind_name(cfg.rng));
+
+    if (cfg.exportPoints) {
+        int ok = export_points(&cfg);
+        free_config(&cfg);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-}
 
-int main() {
     ctx* app = malloc(sizeof(ctx));
     memset(app, 0, sizeof(ctx));
+    app->cfg = cfg;
     uint32_t exit_code = EXIT_SUCCESS;
-    Vertex vertices[NUM_POINTS];
-    memset(vertices, 0, NUM_POINTS * sizeof(Vertex));
 
-    generate_points(NUM_POINTS, vertices);
+    //the file decides how many points there are
+    if (cfg.loadPoints) {
+        if (!point_file_open(&app->pointFile, cfg.loadPoints)) {
+            exit_code = EXIT_FAILURE;
+        } else if (app->pointFile.header->count > UINT32_MAX && !cfg.residentPoints) {
+            fprintf(stderr, "ERROR: %s holds more than %u points, stream it with "
+                    "--resident-points\n", cfg.loadPoints, UINT32_MAX);
+            exit_code = EXIT_FAILURE;
+        } else {
+            //streamed files draw the resident points, see createStream
+            app->cfg.points = app->pointFile.header->count > UINT32_MAX ? UINT32_MAX
+                : (uint32_t) app->pointFile.header->count;
+            fprintf(stdout, "loaded %llu points from %s (%s, seed %llu)\n",
+                    (unsigned long long) app->pointFile.header->count, cfg.loadPoints,
+                    point_layout_name(app->pointFile.header->layout),
+                    (unsigned long long) app->pointFile.header->seed);
+        }
+    }
 
-    if (!initWindow(app)) {
+    if (!exit_code && !app->cfg.headlessOutput && !initWindow(app)) {
         fprintf(stderr, "Problem with window initialization\n");
         exit_code = EXIT_FAILURE;
     }
-    if (!exit_code && !initVulkan(app, vertices)) {
+    if (!exit_code && !initVulkan(app)) {
         fprintf(stderr, "Problem with vulkan initialization\n");
         exit_code = EXIT_FAILURE;
     }
-    if (!exit_code && !mainLoop(app)) {
+    if (!exit_code && app->cfg.headlessOutput) {
+        if (!renderHeadless(app)) {
+            fprintf(stderr, "Problem during headless rendering\n");
+            exit_code = EXIT_FAILURE;
+        }
+    } else if (!exit_code && !mainLoop(app)) {
         fprintf(stderr, "Problem during the main loop\n");
         exit_code = EXIT_FAILURE;
     }
+    if (!exit_code && app->cfg.residentPoints) {
+        streamReport(app);
+    }
+    if (!exit_code) {
+        recordReport(app);
+    }
+    if (!exit_code && app->cfg.benchFrames && !benchReport(app)) {
+        exit_code = EXIT_FAILURE;
+    }
     if (!cleanup(app)) {
         fprintf(stderr, "Problem during cleanup\n");
         exit_code = EXIT_FAILURE;
     }
+    //app->cfg was a copy, its strings are cfg's
+    free_config(&cfg);
 
     return exit_code;
 }
@@ -0,0 +1,232 @@
+#include "pipelinecache.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define CACHE_MAGIC "GASKETPC"
+#define CACHE_VERSION 1u
+//a few pipelines take kilobytes, anything this size is not ours
+#define CACHE_MAX_SIZE (64u << 20)
+
+//the file is this header followed by dataSize bytes of vkGetPipelineCacheData
+typedef struct cacheFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t uuid[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t checksum;
+} cacheFileHeader;
+
+//fnv-1a, only has to catch truncated or damaged files
+static uint64_t checksum(const uint8_t* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+double pipelineCacheClock(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+static void fillHeader(ctx* ctx, cacheFileHeader* header) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->physicalDevice, &props);
+    memset(header, 0, sizeof(cacheFileHeader));
+    memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+    header->version = CACHE_VERSION;
+    header->vendorID = props.vendorID;
+    header->deviceID = props.deviceID;
+    header->driverVersion = props.driverVersion;
+    memcpy(header->uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+//the driver rejects foreign data itself, but not every driver does so
+//gracefully, so its own header is checked against the device as well
+static int validData(const cacheFileHeader* expected, const uint8_t* data, size_t size) {
+    VkPipelineCacheHeaderVersionOne vkHeader;
+    if (size < sizeof(vkHeader)) {
+        return false;
+    }
+    memcpy(&vkHeader, data, sizeof(vkHeader));
+    return vkHeader.headerSize >= sizeof(vkHeader) && vkHeader.headerSize <= size
+        && vkHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && vkHeader.vendorID == expected->vendorID
+        && vkHeader.deviceID == expected->deviceID
+        && memcmp(vkHeader.pipelineCacheUUID, expected->uuid, VK_UUID_SIZE) == 0;
+}
+
+//NULL when the file is missing, from another device or driver, or damaged
+static uint8_t* loadCacheFile(ctx* ctx, size_t* size) {
+    const char* path = ctx->cfg.pipelineCachePath;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    cacheFileHeader expected, header;
+    fillHeader(ctx, &expected);
+    uint8_t* data = NULL;
+    const char* problem = NULL;
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != CACHE_VERSION) {
+        problem = "not a pipeline cache";
+    } else if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID
+            || header.driverVersion != expected.driverVersion
+            || memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) != 0) {
+        problem = "written for another device or driver";
+    } else if (header.dataSize > CACHE_MAX_SIZE) {
+        problem = "damaged";
+    } else {
+        data = malloc(header.dataSize + 1);
+        if (!data || fread(data, 1, header.dataSize, file) != header.dataSize
+                || checksum(data, header.dataSize) != header.checksum
+                || !validData(&expected, data, header.dataSize)) {
+            problem = "damaged";
+        }
+    }
+    fclose(file);
+
+    if (problem) {
+        fprintf(stdout, "pipeline cache: ignoring %s, %s\n", path, problem);
+        free(data);
+        return NULL;
+    }
+    *size = header.dataSize;
+    return data;
+}
+
+int createPipelineCache(ctx* ctx) {
+    pipelineCacheState* p = &ctx->pipelineCache;
+    size_t size = 0;
+    uint8_t* data = ctx->cfg.pipelineCachePath ? loadCacheFile(ctx, &size) : NULL;
+
+    VkPipelineCacheCreateInfo cacheInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = size,
+        .pInitialData = data,
+    };
+    VkResult result = vkCreatePipelineCache(ctx->logicalDevice, &cacheInfo, NULL, &p->cache);
+    if (result != VK_SUCCESS && data) {
+        //stale in some way the headers don't show, start over empty
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = NULL;
+        size = 0;
+        result = vkCreatePipelineCache(ctx->logicalDevice, &cacheInfo, NULL, &p->cache);
+    }
+    if (data && size) {
+        p->loadedChecksum = checksum(data, size);
+        p->loadedBytes = size;
+    }
+    free(data);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create pipeline cache\n");
+        return false;
+    }
+    return true;
+}
+
+//mkdir -p of the directories above path, a default under ~/.cache may not
+//exist yet
+static int makeParents(const char* path) {
+    char dir[4096];
+    int n = snprintf(dir, sizeof(dir), "%s", path);
+    if (n < 0 || (size_t) n >= sizeof(dir)) {
+        return false;
+    }
+    for (char* p = dir + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "ERROR: Couldn't create %s\n", dir);
+            return false;
+        }
+        *p = '/';
+    }
+    return true;
+}
+
+//written next to the target and renamed over it, so a crash or a second
+//instance never leaves a half written cache behind
+static int writeCacheFile(ctx* ctx, const uint8_t* data, size_t size) {
+    const char* path = ctx->cfg.pipelineCachePath;
+    char tmp[4096];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (n < 0 || (size_t) n >= sizeof(tmp)) {
+        fprintf(stderr, "ERROR: pipeline cache path too long\n");
+        return false;
+    }
+
+    if (!makeParents(path)) {
+        return false;
+    }
+
+    cacheFileHeader header;
+    fillHeader(ctx, &header);
+    header.dataSize = size;
+    header.checksum = checksum(data, size);
+
+    FILE* file = fopen(tmp, "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR: Couldn't open %s for writing\n", tmp);
+        return false;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(data, 1, size, file) == size;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "ERROR: Couldn't write pipeline cache %s\n", path);
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+void savePipelineCache(ctx* ctx) {
+    pipelineCacheState* p = &ctx->pipelineCache;
+    fprintf(stdout, "pipeline cache: %.1f ms creating pipelines from a %s cache\n",
+            p->createMs, p->loadedBytes ? "warm" : "cold");
+    if (!ctx->cfg.pipelineCachePath || !p->cache) {
+        return;
+    }
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(ctx->logicalDevice, p->cache, &size, NULL) != VK_SUCCESS
+            || size == 0) {
+        return;
+    }
+    uint8_t* data = malloc(size);
+    if (!data) {
+        return;
+    }
+    //VK_INCOMPLETE if the cache grew in between, then it's saved next run
+    if (vkGetPipelineCacheData(ctx->logicalDevice, p->cache, &size, data) == VK_SUCCESS
+            && (size != p->loadedBytes || checksum(data, size) != p->loadedChecksum)
+            && writeCacheFile(ctx, data, size)) {
+        fprintf(stdout, "pipeline cache: saved %zu bytes to %s\n", size,
+                ctx->cfg.pipelineCachePath);
+    }
+    free(data);
+}
+
+void destroyPipelineCache(ctx* ctx) {
+    pipelineCacheState* p = &ctx->pipelineCache;
+    if (p->cache) { vkDestroyPipelineCache(ctx->logicalDevice, p->cache, NULL); }
+    p->cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,26 @@
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include "vulkan.h"
+
+//--pipeline-cache FILE. every pipeline is created through one
+//VkPipelineCache that is seeded from FILE at startup and written back once
+//all pipelines exist, so only the first launch on a device and driver pays
+//for shader compilation. FILE defaults to gasket/pipeline_cache.bin under
+//$XDG_CACHE_HOME or ~/.cache, whose directories are made on the first save.
+//FILE carries the device's vendor, device id,
+//driver version and cache uuid, a file from anything else is ignored
+
+//needs the logical device, before any pipeline is created. a missing or
+//stale file only means an empty cache
+int createPipelineCache(ctx* ctx);
+
+//milliseconds on a monotonic clock, pipeline creation adds its time to
+//ctx->pipelineCache.createMs
+double pipelineCacheClock(void);
+
+//prints the startup cost and writes the cache back if it grew
+void savePipelineCache(ctx* ctx);
+void destroyPipelineCache(ctx* ctx);
+
+#endif
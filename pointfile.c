@@ -0,0 +1,378 @@
+#include "pointfile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(point_file_header) <= POINT_FILE_HEADER_SIZE,
+        "point file header doesn't fit");
+_Static_assert(sizeof(Vertex) == 20, "f32 records are raw Vertex structs");
+
+static const char* layoutNames[] = { "f32", "f16", "u16" };
+
+int point_layout_from_name(const char* name, point_layout* out) {
+    for (uint32_t i = 0; i < sizeof(layoutNames) / sizeof(layoutNames[0]); i++) {
+        if (strcmp(name, layoutNames[i]) == 0) {
+            *out = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* point_layout_name(point_layout layout) {
+    return layout <= POINT_U16 ? layoutNames[layout] : "unknown";
+}
+
+size_t point_record_size(point_layout layout) {
+    return layout == POINT_F32 ? sizeof(Vertex) : 8;
+}
+
+//round to nearest even, overflow goes to infinity
+static uint16_t float_to_half(float value) {
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000;
+    uint32_t abs = f & 0x7fffffff;
+
+    if (abs >= 0x7f800000) {
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    }
+    if (abs >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+    if (abs < 0x38800000) {
+        //subnormal half, the value in units of 2^-24
+        uint32_t shift = 126 - (abs >> 23);
+        if (shift > 24) {
+            return sign;
+        }
+        uint32_t mant = (abs & 0x7fffff) | 0x800000;
+        uint32_t h = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rest > half || (rest == half && (h & 1))) {
+            h++;
+        }
+        return sign | h;
+    }
+
+    //rebias the exponent from 127 to 15, a mantissa carry bumps the exponent
+    uint32_t h = (abs - 0x38000000) >> 13;
+    uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+        h++;
+    }
+    return sign | h;
+}
+
+static float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    if (exp == 0) {
+        float v = mant * (1.0f / 16777216.0f);
+        return sign ? -v : v;
+    }
+
+    uint32_t f = exp == 31 ? sign | 0x7f800000 | (mant << 13)
+        : sign | ((exp + 112) << 23) | (mant << 13);
+    float out;
+    memcpy(&out, &f, sizeof(out));
+    return out;
+}
+
+static uint8_t to_unorm8(float c) {
+    if (!(c > 0.0f)) {
+        return 0;
+    }
+    return c >= 1.0f ? 255 : (uint8_t) (c * 255.0f + 0.5f);
+}
+
+static uint16_t to_unorm16(float v, float min, float max) {
+    float t = (v - min) / (max - min);
+    if (!(t > 0.0f)) {
+        return 0;
+    }
+    return t >= 1.0f ? 65535 : (uint16_t) (t * 65535.0f + 0.5f);
+}
+
+static void encode(const point_file_header* h, const Vertex* points, uint64_t count,
+        uint8_t* out) {
+    if (h->layout == POINT_F32) {
+        memcpy(out, points, count * sizeof(Vertex));
+        return;
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        const Vertex* v = &points[i];
+        uint16_t pos[2];
+        for (int k = 0; k < 2; k++) {
+            pos[k] = h->layout == POINT_F16 ? float_to_half(v->pos[k])
+                : to_unorm16(v->pos[k], h->min[k], h->max[k]);
+        }
+        uint8_t* r = out + 8 * i;
+        memcpy(r, pos, sizeof(pos));
+        r[4] = to_unorm8(v->color[0]);
+        r[5] = to_unorm8(v->color[1]);
+        r[6] = to_unorm8(v->color[2]);
+        r[7] = 255;
+    }
+}
+
+static void decode(const point_file_header* h, const uint8_t* in, uint64_t count,
+        Vertex* points) {
+    if (h->layout == POINT_F32) {
+        memcpy(points, in, count * sizeof(Vertex));
+        return;
+    }
+
+    float scale[2] = {
+        (h->max[0] - h->min[0]) / 65535.0f,
+        (h->max[1] - h->min[1]) / 65535.0f,
+    };
+    for (uint64_t i = 0; i < count; i++) {
+        const uint8_t* r = in + 8 * i;
+        uint16_t pos[2];
+        memcpy(pos, r, sizeof(pos));
+        Vertex* v = &points[i];
+        for (int k = 0; k < 2; k++) {
+            v->pos[k] = h->layout == POINT_F16 ? half_to_float(pos[k])
+                : h->min[k] + pos[k] * scale[k];
+        }
+        v->color[0] = r[4] / 255.0f;
+        v->color[1] = r[5] / 255.0f;
+        v->color[2] = r[6] / 255.0f;
+    }
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+    const uint8_t* p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+int point_writer_open(point_writer* w, const char* path, point_layout layout,
+        uint64_t count, uint64_t seed, uint32_t rng) {
+    memset(w, 0, sizeof(point_writer));
+    w->path = path;
+    point_file_header* h = &w->header;
+    memcpy(h->magic, POINT_FILE_MAGIC, sizeof(h->magic));
+    h->version = POINT_FILE_VERSION;
+    h->layout = layout;
+    h->count = count;
+    h->seed = seed;
+    h->rng = rng;
+    h->chunkPoints = POINT_FILE_CHUNK;
+    //the view, presets and fitted ifs files all lie inside. appends check
+    //it for u16, so these are the bounds the records were encoded over
+    h->min[0] = h->min[1] = -1.0f;
+    h->max[0] = h->max[1] = 1.0f;
+
+    uint8_t* header = calloc(1, POINT_FILE_HEADER_SIZE);
+    w->chunk = malloc(POINT_FILE_CHUNK * point_record_size(layout));
+    if (!header || !w->chunk) {
+        fprintf(stderr, "ERROR: Couldn't allocate point file buffers\n");
+        free(header);
+        free(w->chunk);
+        return false;
+    }
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        fprintf(stderr, "ERROR: Couldn't open %s for writing\n", path);
+        free(header);
+        free(w->chunk);
+        return false;
+    }
+
+    memcpy(header, h, sizeof(point_file_header));
+    int ok = write_all(w->fd, header, POINT_FILE_HEADER_SIZE);
+    free(header);
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't write %s\n", path);
+        close(w->fd);
+        free(w->chunk);
+        return false;
+    }
+    return true;
+}
+
+static int flush_chunk(point_writer* w) {
+    if (w->fill == 0) {
+        return true;
+    }
+    if (!write_all(w->fd, w->chunk, w->fill * point_record_size(w->header.layout))) {
+        fprintf(stderr, "ERROR: Couldn't write %s\n", w->path);
+        return false;
+    }
+    w->fill = 0;
+    return true;
+}
+
+//u16 positions can't say a point was clamped, so one outside the header's
+//box fails the export instead of being written somewhere else
+static int in_bounds(point_writer* w, const Vertex* points, uint64_t count) {
+    const point_file_header* h = &w->header;
+    if (h->layout != POINT_U16) {
+        return true;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        const float* pos = points[i].pos;
+        if (!(pos[0] >= h->min[0] && pos[0] <= h->max[0]
+                    && pos[1] >= h->min[1] && pos[1] <= h->max[1])) {
+            fprintf(stderr, "ERROR: %s: point (%g, %g) is outside the u16 bounds "
+                    "[%g, %g] x [%g, %g], export it as f32 or f16\n", w->path, pos[0],
+                    pos[1], h->min[0], h->max[0], h->min[1], h->max[1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int point_writer_append(point_writer* w, const Vertex* points, uint64_t count) {
+    size_t record = point_record_size(w->header.layout);
+    if (!in_bounds(w, points, count)) {
+        return false;
+    }
+    while (count > 0) {
+        uint64_t n = POINT_FILE_CHUNK - w->fill;
+        if (n > count) {
+            n = count;
+        }
+        encode(&w->header, points, n, w->chunk + w->fill * record);
+        w->fill += n;
+        w->written += n;
+        points += n;
+        count -= n;
+        if (w->fill == POINT_FILE_CHUNK && !flush_chunk(w)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int point_writer_close(point_writer* w) {
+    int ok = flush_chunk(w);
+    if (ok && w->written != w->header.count) {
+        fprintf(stderr, "ERROR: %s: header says %llu points, got %llu\n", w->path,
+                (unsigned long long) w->header.count, (unsigned long long) w->written);
+        ok = false;
+    }
+    if (close(w->fd) != 0) {
+        fprintf(stderr, "ERROR: Couldn't write %s\n", w->path);
+        ok = false;
+    }
+    free(w->chunk);
+    w->chunk = NULL;
+    return ok;
+}
+
+int point_file_open(point_file* f, const char* path) {
+    memset(f, 0, sizeof(point_file));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Couldn't open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < POINT_FILE_HEADER_SIZE) {
+        fprintf(stderr, "ERROR: %s is not a point file\n", path);
+        close(fd);
+        return false;
+    }
+
+    //the mapping keeps the file alive, the descriptor isn't needed anymore
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Couldn't map %s\n", path);
+        return false;
+    }
+    f->size = st.st_size;
+    f->header = map;
+    f->data = (const uint8_t*) map + POINT_FILE_HEADER_SIZE;
+
+    const point_file_header* h = f->header;
+    if (memcmp(h->magic, POINT_FILE_MAGIC, sizeof(h->magic)) != 0
+            || h->version != POINT_FILE_VERSION || h->layout > POINT_U16) {
+        fprintf(stderr, "ERROR: %s is not a version %u point file\n", path,
+                POINT_FILE_VERSION);
+        point_file_close(f);
+        return false;
+    }
+    size_t record = point_record_size(h->layout);
+    if (!h->count) {
+        fprintf(stderr, "ERROR: %s has no points\n", path);
+        point_file_close(f);
+        return false;
+    }
+    //chunks start on a page after the header, readers map and stream them on
+    //their own
+    if (!h->chunkPoints || (h->chunkPoints * record) % POINT_FILE_HEADER_SIZE != 0) {
+        fprintf(stderr, "ERROR: %s has chunks of %u points, which aren't whole pages\n", path,
+                h->chunkPoints);
+        point_file_close(f);
+        return false;
+    }
+    if (h->count >(f->size - POINT_FILE_HEADER_SIZE) / record
+            || POINT_FILE_HEADER_SIZE + h->count * record != f->size) {
+        fprintf(stderr, "ERROR: %s is truncated or has trailing data\n", path);
+        point_file_close(f);
+        return false;
+    }
+
+    //loads walk the file front to back once
+    madvise(map, f->size, MADV_SEQUENTIAL);
+    return true;
+}
+
+int point_file_read(const point_file* f, uint64_t first, uint64_t count, Vertex* out) {
+    if (first > f->header->count || count > f->header->count - first) {
+        fprintf(stderr, "ERROR: point file read past the end\n");
+        return false;
+    }
+    decode(f->header, f->data + first * point_record_size(f->header->layout), count, out);
+    return true;
+}
+
+int point_file_read_packed(const point_file* f, uint64_t first, uint64_t count,
+        PackedVertex* out) {
+    //decoded through a small float batch that stays in cache
+    Vertex batch[1024];
+    const uint64_t perBatch = sizeof(batch) / sizeof(batch[0]);
+    for (uint64_t done = 0; done < count; done += perBatch) {
+        uint64_t n = count - done < perBatch ? count - done : perBatch;
+        if (!point_file_read(f, first + done, n, batch)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            const Vertex* v = &batch[i];
+            out[done + i] = packVertex(v->pos[0], v->pos[1], v->color[0], v->color[1],
+                    v->color[2]);
+        }
+    }
+    return true;
+}
+
+void point_file_close(point_file* f) {
+    if (f->header) {
+        munmap((void*) f->header, f->size);
+    }
+    memset(f, 0, sizeof(point_file));
+}
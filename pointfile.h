@@ -0,0 +1,82 @@
+#ifndef POINTFILE_H
+#define POINTFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vertex.h"
+
+//binary point set files, little endian:
+//  a POINT_FILE_HEADER_SIZE byte header (point_file_header, zero padded)
+//  then count records in chunks of chunkPoints. chunks are whole pages for
+//  every layout, so any chunk can be mapped, streamed or read on its own
+//
+//records per layout:
+//  f32  the Vertex struct as is, 20 bytes. loads with a plain copy
+//  f16  half float x, y then rgba8, 8 bytes
+//  u16  x, y quantized over [min, max] of the header then rgba8, 8 bytes.
+//       the writer uses [-1, 1] and refuses points outside of it
+
+#define POINT_FILE_MAGIC "SGPOINTS"
+#define POINT_FILE_VERSION 1
+#define POINT_FILE_HEADER_SIZE 4096
+#define POINT_FILE_CHUNK 65536
+
+typedef enum point_layout {
+    POINT_F32 = 0,
+    POINT_F16,
+    POINT_U16,
+} point_layout;
+
+typedef struct point_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint64_t count;
+    //how the points were made, for reproducing them
+    uint64_t seed;
+    uint32_t rng;
+    uint32_t chunkPoints;
+    float min[2];
+    float max[2];
+    uint8_t reserved[8];
+} point_file_header;
+
+int point_layout_from_name(const char* name, point_layout* out);
+const char* point_layout_name(point_layout layout);
+size_t point_record_size(point_layout layout);
+
+//streams points to a file a chunk at a time, so the whole set never has to
+//be in memory. count is fixed up front and checked on close
+typedef struct point_writer {
+    int fd;
+    const char* path;
+    point_file_header header;
+    uint64_t written;
+    uint8_t* chunk;
+    uint32_t fill;
+} point_writer;
+
+int point_writer_open(point_writer* w, const char* path, point_layout layout,
+        uint64_t count, uint64_t seed, uint32_t rng);
+//false if a write failed or, for u16, a point is outside the header's bounds
+int point_writer_append(point_writer* w, const Vertex* points, uint64_t count);
+//false if fewer or more than count points were appended or a write failed.
+//the writer is closed either way
+int point_writer_close(point_writer* w);
+
+//read only mapping of a point file, the header is validated against the
+//file size on open
+typedef struct point_file {
+    const point_file_header* header;
+    const uint8_t* data;
+    size_t size;
+} point_file;
+
+int point_file_open(point_file* f, const char* path);
+//decodes count points starting at first into out
+int point_file_read(const point_file* f, uint64_t first, uint64_t count, Vertex* out);
+int point_file_read_packed(const point_file* f, uint64_t first, uint64_t count,
+        PackedVertex* out);
+void point_file_close(point_file* f);
+
+#endif
@@ -0,0 +1,682 @@
+#include "progressive.h"
+#include "arena.h"
+#include "bench.h"
+#include "camera.h"
+#include "gpugen.h"
+#include "pipelinecache.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//most the gpu generator's budget grows with zoom, 32x per axis. further in
+//the view gets sparser instead of the refinement never finishing
+#define PROGRESSIVE_MAX_SCALE 1024.0
+
+//between frames the image waits for its reader: the copy to the swapchain
+//image, or the present pass's fragment shader
+static VkImageLayout accumLayout(ctx* ctx) {
+    return ctx->progressive.copyToSwapchain ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+        : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+static VkPipelineStageFlags accumReadStage(ctx* ctx) {
+    return ctx->progressive.copyToSwapchain ? VK_PIPELINE_STAGE_TRANSFER_BIT
+        : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+//loadOp LOAD keeps everything drawn so far, CLEAR starts over. the two only
+//differ in loadOp, so they are compatible and share the framebuffer
+static int createAccumRenderPass(ctx* ctx, VkAttachmentLoadOp loadOp,
+        VkRenderPass* renderPass) {
+    //same format and sample count as ctx->renderPass, so the two are
+    //compatible and graphicsPipeline can be used with either
+    VkAttachmentDescription colorAttachment = {
+        .format = ctx->swapchainImageFormat,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = loadOp,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = accumLayout(ctx),
+        .finalLayout = accumLayout(ctx),
+    };
+
+    VkAttachmentReference colorAttachmentRef = {
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+    VkSubpassDescription subpass = {
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachmentRef,
+    };
+
+    //the image is shared by every frame in flight: a frame's draw has to wait
+    //for the previous frame's draw (load) and read (overwrite), and its own
+    //read has to wait for its draw
+    VkSubpassDependency dependencies[] = {
+        {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                | accumReadStage(ctx),
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+                | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        },
+        {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = accumReadStage(ctx),
+            .dstAccessMask = ctx->progressive.copyToSwapchain ? VK_ACCESS_TRANSFER_READ_BIT
+                : VK_ACCESS_SHADER_READ_BIT,
+        },
+    };
+
+    VkRenderPassCreateInfo renderpassInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = 1,
+        .pAttachments = &colorAttachment,
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = 2,
+        .pDependencies = dependencies,
+    };
+
+    if (vkCreateRenderPass(ctx->logicalDevice, &renderpassInfo, NULL, renderPass)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create accumulation render pass\n");
+        return false;
+    }
+    return true;
+}
+
+static void destroyProgressiveTarget(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    if (p->accumFramebuffer) { vkDestroyFramebuffer(ctx->logicalDevice, p->accumFramebuffer, NULL); }
+    if (p->accumView) { vkDestroyImageView(ctx->logicalDevice, p->accumView, NULL); }
+    if (p->accumImage) { vkDestroyImage(ctx->logicalDevice, p->accumImage, NULL); }
+    arenaFree(ctx, &p->accumMemory);
+    p->accumFramebuffer = VK_NULL_HANDLE;
+    p->accumView = VK_NULL_HANDLE;
+    p->accumImage = VK_NULL_HANDLE;
+}
+
+//clears to the same black the normal render pass clears to and leaves the
+//image in the layout the accumulation render pass expects
+static int clearAccumImage(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(ctx, ctx->graphicsCommandPool);
+    if (commandBuffer == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+    VkImageMemoryBarrier toClear = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = p->accumImage,
+        .subresourceRange = range,
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &toClear);
+
+    VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    vkCmdClearColorImage(commandBuffer, p->accumImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            &black, 1, &range);
+
+    VkImageMemoryBarrier toRender = toClear;
+    toRender.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toRender.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+        | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toRender.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toRender.newLayout = accumLayout(ctx);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, NULL, 0, NULL, 1, &toRender);
+
+    return endSingleTimeCommands(ctx, ctx->graphicsCommandPool, ctx->graphicsQueue,
+            commandBuffer);
+}
+
+static int createProgressiveTarget(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+        | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+        | (p->copyToSwapchain ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VK_IMAGE_USAGE_SAMPLED_BIT);
+    if (!createImage(ctx, ctx->swapchainExtent.width, ctx->swapchainExtent.height,
+                ctx->swapchainImageFormat, usage, &p->accumImage, &p->accumMemory)) {
+        fprintf(stderr, "ERROR: Couldn't create accumulation image\n");
+        return false;
+    }
+    if (!createImageView(ctx, p->accumImage, ctx->swapchainImageFormat, &p->accumView)) {
+        fprintf(stderr, "ERROR: Couldn't create accumulation image view\n");
+        return false;
+    }
+
+    VkFramebufferCreateInfo framebufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass = p->accumRenderPass,
+        .attachmentCount = 1,
+        .pAttachments = &p->accumView,
+        .width = ctx->swapchainExtent.width,
+        .height = ctx->swapchainExtent.height,
+        .layers = 1,
+    };
+    if (vkCreateFramebuffer(ctx->logicalDevice, &framebufferInfo, NULL,
+                &p->accumFramebuffer) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create accumulation framebuffer\n");
+        return false;
+    }
+
+    if (!p->copyToSwapchain) {
+        VkDescriptorImageInfo imageInfo = {
+            .sampler = p->sampler,
+            .imageView = p->accumView,
+            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        };
+        VkWriteDescriptorSet write = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = p->descriptorSet,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &imageInfo,
+        };
+        vkUpdateDescriptorSets(ctx->logicalDevice, 1, &write, 0, NULL);
+    }
+
+    p->cameraVersion = ctx->camera.version;
+    return clearAccumImage(ctx);
+}
+
+int recreateProgressiveTarget(ctx* ctx) {
+    destroyProgressiveTarget(ctx);
+    ctx->progressive.generated = 0;
+    return createProgressiveTarget(ctx);
+}
+
+//sampler and descriptor set the present pass reads the image through, the
+//set is pointed at the image by createProgressiveTarget
+static int createPresentDescriptors(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod = 0.0f,
+    };
+    if (vkCreateSampler(ctx->logicalDevice, &samplerInfo, NULL, &p->sampler) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create accumulation sampler\n");
+        return false;
+    }
+
+    VkDescriptorSetLayoutBinding binding = {
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &binding,
+    };
+    if (vkCreateDescriptorSetLayout(ctx->logicalDevice, &setLayoutInfo, NULL,
+                &p->setLayout) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create present descriptor set layout\n");
+        return false;
+    }
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = 1,
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+    };
+    if (vkCreateDescriptorPool(ctx->logicalDevice, &poolInfo, NULL,
+                &p->descriptorPool) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create present descriptor pool\n");
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = p->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &p->setLayout,
+    };
+    if (vkAllocateDescriptorSets(ctx->logicalDevice, &allocInfo, &p->descriptorSet)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate present descriptor set\n");
+        return false;
+    }
+    return true;
+}
+
+//fullscreen triangle in ctx->renderPass that writes the image's texels to
+//the swapchain image, for surfaces that can't be copied to
+static int createPresentPipeline(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    VkShaderModule vertexShader, fragmentShader;
+    if (!createShader(ctx->logicalDevice, TONEMAP_VERT_SHADER, &vertexShader)) {
+        fprintf(stderr, "Present vertex shader couldn't be loaded\n");
+        return false;
+    }
+    if (!createShader(ctx->logicalDevice, PRESENT_FRAG_SHADER, &fragmentShader)) {
+        fprintf(stderr, "Present fragment shader couldn't be loaded\n");
+        vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
+        return false;
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertexShader,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragmentShader,
+            .pName = "main",
+        },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    };
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+    VkDynamicState dynamicStates[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = sizeof(dynamicStates) / sizeof(VkDynamicState),
+        .pDynamicStates = dynamicStates,
+    };
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1,
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+    };
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .sampleShadingEnable = VK_FALSE,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .minSampleShading = 1.0f,
+    };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+                        | VK_COLOR_COMPONENT_G_BIT
+                        | VK_COLOR_COMPONENT_B_BIT
+                        | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = VK_FALSE,
+    };
+    VkPipelineColorBlendStateCreateInfo colorBlending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .attachmentCount = 1,
+        .pAttachments = &colorBlendAttachment,
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &p->setLayout,
+    };
+    int ok = vkCreatePipelineLayout(ctx->logicalDevice, &pipelineLayoutInfo, NULL,
+            &p->presentLayout) == VK_SUCCESS;
+    if (!ok) {
+        fprintf(stderr, "ERROR: Couldn't create present pipeline layout\n");
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 2,
+        .pStages = shaderStages,
+        .pVertexInputState = &vertexInputInfo,
+        .pInputAssemblyState = &inputAssembly,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizer,
+        .pMultisampleState = &multisampling,
+        .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
+        .layout = p->presentLayout,
+        .renderPass = ctx->renderPass,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+    double start = pipelineCacheClock();
+    if (ok && vkCreateGraphicsPipelines(ctx->logicalDevice, ctx->pipelineCache.cache, 1,
+                &pipelineInfo, NULL, &p->presentPipeline) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create the present pipeline\n");
+        ok = false;
+    }
+    ctx->pipelineCache.createMs += pipelineCacheClock() - start;
+
+    vkDestroyShaderModule(ctx->logicalDevice, vertexShader, NULL);
+    vkDestroyShaderModule(ctx->logicalDevice, fragmentShader, NULL);
+    return ok;
+}
+
+int createProgressive(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    if (ctx->cfg.pointsPerFrame > ctx->cfg.points) {
+        ctx->cfg.pointsPerFrame = ctx->cfg.points;
+    }
+
+    p->slotCount = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(uint32_t));
+    if (!p->slotCount) {
+        fprintf(stderr, "ERROR: Couldn't allocate progressive state\n");
+        return false;
+    }
+
+    VkDeviceSize ringSize = (VkDeviceSize) ctx->MAX_FRAMES_IN_FLIGHT
+        * ctx->cfg.pointsPerFrame * vertexStride(ctx);
+    if (ctx->cfg.gpuGenerate) {
+        if (!createBuffer(ctx, ringSize,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &p->ringBuffer, &p->ringMemory)
+                || !createGpugen(ctx, p->ringBuffer, ringSize, ctx->MAX_FRAMES_IN_FLIGHT,
+                    VK_TRUE)) {
+            fprintf(stderr, "ERROR: Couldn't create progressive ring buffer\n");
+            return false;
+        }
+    } else {
+        //written once and read once per frame, not worth a staging copy. on
+        //unified memory it's device local as well
+        VkMemoryPropertyFlags props = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (ctx->unifiedMemory) {
+            props |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
+        if (!createBuffer(ctx, ringSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, props,
+                    &p->ringBuffer, &p->ringMemory)) {
+            fprintf(stderr, "ERROR: Couldn't create progressive ring buffer\n");
+            return false;
+        }
+        p->ringMapped = p->ringMemory.mapped;
+
+        //the engine keeps its walkers between batches, so the sequence of
+        //points is the same one a single generate_points call would produce
+        if (!chaos_init(&p->engine, &ctx->cfg.fractal, ctx->cfg.seed, ctx->cfg.threads,
+                    ctx->cfg.rng)
+                || !chaos_select_isa(&p->engine, ctx->cfg.isa)) {
+            return false;
+        }
+    }
+
+    if (!createAccumRenderPass(ctx, VK_ATTACHMENT_LOAD_OP_LOAD, &p->accumRenderPass)
+            || !createAccumRenderPass(ctx, VK_ATTACHMENT_LOAD_OP_CLEAR,
+                &p->accumClearRenderPass)) {
+        return false;
+    }
+    if (!p->copyToSwapchain) {
+        fprintf(stdout, "progressive: surface can't be copied to, drawing the "
+                "accumulation image in instead\n");
+        if (!createPresentDescriptors(ctx) || !createPresentPipeline(ctx)) {
+            return false;
+        }
+    }
+    return createProgressiveTarget(ctx);
+}
+
+//the gpu generator only keeps the points in view, and at zoom z only about
+//1/z^2 of them land there. generating that much more gives the view the
+//density --points has at the full view, up to PROGRESSIVE_MAX_SCALE times
+//--points
+static uint64_t pointBudget(ctx* ctx) {
+    if (!ctx->cfg.gpuGenerate) {
+        return ctx->cfg.points;
+    }
+    vertexParams view = cameraVertexParams(ctx);
+    double scale = (double) view.zoom[0] * view.zoom[1];
+    if (scale <= 1.0) {
+        return ctx->cfg.points;
+    }
+    if (scale > PROGRESSIVE_MAX_SCALE) {
+        scale = PROGRESSIVE_MAX_SCALE;
+    }
+    return (uint64_t) (ctx->cfg.points * scale);
+}
+
+int progressiveNextBatch(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    uint32_t slot = ctx->currentFrame;
+
+    //the image only holds one view, a moved camera starts the refinement over
+    if (p->cameraVersion != ctx->camera.version) {
+        p->cameraVersion = ctx->camera.version;
+        p->generated = 0;
+        p->clear = true;
+    }
+
+    uint64_t remaining = pointBudget(ctx) - p->generated;
+    uint32_t count = remaining < ctx->cfg.pointsPerFrame
+        ? (uint32_t) remaining : ctx->cfg.pointsPerFrame;
+    p->slotCount[slot] = count;
+    p->generated += count;
+
+    //the slot's previous draw has finished, so its slice is free to overwrite
+    if (count && !ctx->cfg.gpuGenerate) {
+        void* dst = (uint8_t*) p->ringMapped
+            + (uint64_t) slot * ctx->cfg.pointsPerFrame * vertexStride(ctx);
+        int ok = ctx->cfg.packedVertices ? chaos_generate_packed(&p->engine, count, dst)
+            : chaos_generate(&p->engine, count, dst);
+        if (!ok) {
+            fprintf(stderr, "ERROR: Couldn't generate progressive batch\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+//the accumulation pass's dependency already makes its writes visible to
+//this fragment shader
+static void recordPresentPass(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    progressiveState* p = &ctx->progressive;
+    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f,}}};
+    VkRenderPassBeginInfo renderPassInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = ctx->renderPass,
+        .framebuffer = ctx->swapchainFramebuffers[imageIndex],
+        .renderArea.offset = {0, 0},
+        .renderArea.extent = ctx->swapchainExtent,
+        .clearValueCount = 1,
+        .pClearValues = &clearColor,
+    };
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                p->presentPipeline);
+
+        VkViewport viewport = {
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = (float) ctx->swapchainExtent.width,
+            .height = (float) ctx->swapchainExtent.height,
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f,
+        };
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {
+            .offset = {0, 0},
+            .extent = ctx->swapchainExtent,
+        };
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                p->presentLayout, 0, 1, &p->descriptorSet, 0, NULL);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void recordProgressive(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    progressiveState* p = &ctx->progressive;
+    uint32_t slot = ctx->currentFrame;
+    uint32_t count = p->slotCount[slot];
+    uint64_t first = (uint64_t) slot * ctx->cfg.pointsPerFrame;
+
+    //the slot's draw command is only rewritten when there are new points
+    if (count && ctx->cfg.gpuGenerate) {
+        recordGpugen(ctx, commandBuffer, p->ringBuffer, first, count, slot);
+    }
+
+    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f,}}};
+    VkRenderPassBeginInfo renderPassInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = p->clear ? p->accumClearRenderPass : p->accumRenderPass,
+        .framebuffer = p->accumFramebuffer,
+        .renderArea.offset = {0, 0},
+        .renderArea.extent = ctx->swapchainExtent,
+        .clearValueCount = p->clear ? 1 : 0,
+        .pClearValues = p->clear ? &clearColor : NULL,
+    };
+    p->clear = false;
+
+    benchBeginFrame(ctx, commandBuffer);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                ctx->graphicsPipeline);
+
+        VkViewport viewport = {
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = (float) ctx->swapchainExtent.width,
+            .height = (float) ctx->swapchainExtent.height,
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f,
+        };
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {
+            .offset = {0, 0},
+            .extent = ctx->swapchainExtent,
+        };
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        vertexParams params = cameraVertexParams(ctx);
+        vkCmdPushConstants(commandBuffer, ctx->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+                0, sizeof(params), &params);
+
+        //once --points have been drawn the pass only keeps the image. how
+        //many of the gpu's points survived culling is only known on the gpu
+        if (count) {
+            VkDeviceSize offset = first * vertexStride(ctx);
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &p->ringBuffer, &offset);
+            if (ctx->cfg.gpuGenerate) {
+                recordGpugenDraw(ctx, commandBuffer, slot);
+            } else {
+                vkCmdDraw(commandBuffer, count, 1, 0, 0);
+            }
+        }
+    vkCmdEndRenderPass(commandBuffer);
+    benchEndFrame(ctx, commandBuffer);
+
+    if (!p->copyToSwapchain) {
+        recordPresentPass(ctx, commandBuffer, imageIndex);
+        return;
+    }
+
+    VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+    //srcStage matches the imageAvailable wait stage in drawFrame
+    VkImageMemoryBarrier toCopy = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = ctx->swapchainImages[imageIndex],
+        .subresourceRange = range,
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &toCopy);
+
+    VkImageCopy region = {
+        .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .srcOffset = { 0, 0, 0 },
+        .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .dstOffset = { 0, 0, 0 },
+        .extent = { ctx->swapchainExtent.width, ctx->swapchainExtent.height, 1 },
+    };
+    vkCmdCopyImage(commandBuffer, p->accumImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            ctx->swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &region);
+
+    VkImageMemoryBarrier toPresent = toCopy;
+    toPresent.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toPresent.dstAccessMask = 0;
+    toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &toPresent);
+}
+
+void destroyProgressive(ctx* ctx) {
+    progressiveState* p = &ctx->progressive;
+    destroyProgressiveTarget(ctx);
+    destroyGpugen(ctx);
+    chaos_destroy(&p->engine);
+    if (p->presentPipeline) { vkDestroyPipeline(ctx->logicalDevice, p->presentPipeline, NULL); }
+    if (p->presentLayout) { vkDestroyPipelineLayout(ctx->logicalDevice, p->presentLayout, NULL); }
+    if (p->descriptorPool) { vkDestroyDescriptorPool(ctx->logicalDevice, p->descriptorPool, NULL); }
+    if (p->setLayout) { vkDestroyDescriptorSetLayout(ctx->logicalDevice, p->setLayout, NULL); }
+    if (p->sampler) { vkDestroySampler(ctx->logicalDevice, p->sampler, NULL); }
+    if (p->accumRenderPass) { vkDestroyRenderPass(ctx->logicalDevice, p->accumRenderPass, NULL); }
+    if (p->accumClearRenderPass) { vkDestroyRenderPass(ctx->logicalDevice, p->accumClearRenderPass, NULL); }
+    if (p->ringBuffer) { vkDestroyBuffer(ctx->logicalDevice, p->ringBuffer, NULL); }
+    arenaFree(ctx, &p->ringMemory);
+    if (p->slotCount) { free(p->slotCount); }
+}
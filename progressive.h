@@ -0,0 +1,27 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "vulkan.h"
+
+//--progressive N. every frame N new points are generated (cpu or gpu) into
+//that frame slot's slice of a ring buffer and drawn into an accumulation
+//image that is only cleared when the camera moves, which is then copied to
+//the swapchain image, or drawn into it by a fullscreen pass when the surface
+//doesn't allow transfer writes. per frame cost is bounded by N instead of growing
+//with --points. the gpu generator culls to the view and draws indirect, the
+//host never learns how many points each frame kept
+
+//ring buffer, render pass and accumulation target. replaces createVertexBuffer
+int createProgressive(ctx* ctx);
+
+//the accumulation image follows the swapchain extent, recreating it starts
+//the refinement over
+int recreateProgressiveTarget(ctx* ctx);
+
+//call once the current slot's fence has signalled and an image was acquired.
+//cpu generation happens here, gpu generation is recorded into the frame
+int progressiveNextBatch(ctx* ctx);
+void recordProgressive(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex);
+void destroyProgressive(ctx* ctx);
+
+#endif
@@ -0,0 +1,283 @@
+#include "record.h"
+#include "bench.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct recordWorker {
+    ctx* ctx;
+    uint32_t index;
+    pthread_t thread;
+    uint32_t started;
+    uint32_t quit;
+    //command pools are externally synchronized, every worker has its own
+    VkCommandPool pool;
+    //secondaries laid out like recordState.buffers
+    VkCommandBuffer* buffers;
+    sem_t start;
+    sem_t done;
+    int ok;
+};
+
+static double nowMs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+void recordShare(uint32_t n, uint32_t part, uint32_t parts, uint32_t* first,
+        uint32_t* count) {
+    uint64_t begin = (uint64_t) n * part / parts;
+    uint64_t end = (uint64_t) n * (part + 1) / parts;
+    *first = (uint32_t) begin;
+    *count = (uint32_t) (end - begin);
+}
+
+//the secondary of the current frame slot and r->image, set before start
+static int recordWorkerShare(recordWorker* w) {
+    ctx* ctx = w->ctx;
+    recordState* r = &ctx->record;
+    uint32_t image = r->image;
+    VkCommandBuffer commandBuffer = w->buffers[ctx->currentFrame * r->numImages + image];
+
+    //the frame's pipeline statistics query stays active across the pass
+    VkCommandBufferInheritanceInfo inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = ctx->renderPass,
+        .subpass = 0,
+        .framebuffer = ctx->swapchainFramebuffers[image],
+        .pipelineStatistics = ctx->bench.hasPipelineStatistics ? BENCH_STATISTICS : 0,
+    };
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritance,
+    };
+
+    vkResetCommandBuffer(commandBuffer, 0);
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't begin recording secondary command buffer %u\n",
+                w->index);
+        return false;
+    }
+    recordPointSetDraws(ctx, commandBuffer, w->index, r->numWorkers);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't record secondary command buffer %u\n", w->index);
+        return false;
+    }
+    return true;
+}
+
+static void* recordWorkerMain(void* arg) {
+    recordWorker* w = arg;
+    for (;;) {
+        while (sem_wait(&w->start) != 0 && errno == EINTR) {
+        }
+        if (w->quit) {
+            return NULL;
+        }
+        w->ok = recordWorkerShare(w);
+        sem_post(&w->done);
+    }
+}
+
+static int allocateBuffers(ctx* ctx) {
+    recordState* r = &ctx->record;
+    r->numImages = ctx->numSwapchainImages;
+    uint32_t count = ctx->MAX_FRAMES_IN_FLIGHT * r->numImages;
+    r->buffers = calloc(count, sizeof(VkCommandBuffer));
+    r->stamps = calloc(count, sizeof(uint64_t));
+    if (!r->buffers || !r->stamps) {
+        fprintf(stderr, "ERROR: Couldn't allocate command buffer state\n");
+        return false;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx->graphicsCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = count,
+    };
+    if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, r->buffers)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate command buffers\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < r->numWorkers; i++) {
+        recordWorker* w = &r->workers[i];
+        w->buffers = calloc(count, sizeof(VkCommandBuffer));
+        if (!w->buffers) {
+            fprintf(stderr, "ERROR: Couldn't allocate command buffer state\n");
+            return false;
+        }
+        allocInfo.commandPool = w->pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, w->buffers)
+                != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't allocate secondary command buffers\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+//null handles are skipped by vkFreeCommandBuffers, so this also cleans up
+//after a failed allocateBuffers
+static void freeBuffers(ctx* ctx) {
+    recordState* r = &ctx->record;
+    uint32_t count = ctx->MAX_FRAMES_IN_FLIGHT * r->numImages;
+    if (r->buffers) {
+        vkFreeCommandBuffers(ctx->logicalDevice, ctx->graphicsCommandPool, count, r->buffers);
+        free(r->buffers);
+    }
+    if (r->stamps) { free(r->stamps); }
+    r->buffers = NULL;
+    r->stamps = NULL;
+
+    for (uint32_t i = 0; i < r->numWorkers; i++) {
+        recordWorker* w = &r->workers[i];
+        if (w->buffers) {
+            vkFreeCommandBuffers(ctx->logicalDevice, w->pool, count, w->buffers);
+            free(w->buffers);
+        }
+        w->buffers = NULL;
+    }
+}
+
+static int createWorker(ctx* ctx, recordWorker* w, uint32_t index) {
+    qfi indices;
+    findQueueFamilies(ctx->physicalDevice, ctx->surface, &indices);
+    VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = indices.graphicsFamily,
+    };
+    if (vkCreateCommandPool(ctx->logicalDevice, &poolInfo, NULL, &w->pool) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't create a recording thread's command pool\n");
+        return false;
+    }
+
+    if (sem_init(&w->start, 0, 0) != 0 || sem_init(&w->done, 0, 0) != 0) {
+        fprintf(stderr, "ERROR: Couldn't create recording thread semaphores\n");
+        return false;
+    }
+    w->ctx = ctx;
+    w->index = index;
+    if (pthread_create(&w->thread, NULL, recordWorkerMain, w) != 0) {
+        fprintf(stderr, "ERROR: Couldn't start recording thread %u\n", index);
+        return false;
+    }
+    w->started = true;
+    return true;
+}
+
+int createRecording(ctx* ctx) {
+    recordState* r = &ctx->record;
+    if (ctx->cfg.recordThreads) {
+        r->workers = calloc(ctx->cfg.recordThreads, sizeof(recordWorker));
+        if (!r->workers) {
+            fprintf(stderr, "ERROR: Couldn't allocate recording threads\n");
+            return false;
+        }
+        r->numWorkers = ctx->cfg.recordThreads;
+        for (uint32_t i = 0; i < r->numWorkers; i++) {
+            if (!createWorker(ctx, &r->workers[i], i)) {
+                return false;
+            }
+        }
+    }
+    return allocateBuffers(ctx);
+}
+
+//only called with the device idle, nothing recorded is still pending
+int recreateRecording(ctx* ctx) {
+    freeBuffers(ctx);
+    return allocateBuffers(ctx);
+}
+
+VkCommandBuffer frameCommandBuffer(ctx* ctx, uint32_t imageIndex) {
+    recordState* r = &ctx->record;
+    uint32_t index = ctx->currentFrame * r->numImages + imageIndex;
+    VkCommandBuffer commandBuffer = r->buffers[index];
+
+    //0 never matches, a recording's stamp is at least 1
+    uint64_t stamp = ctx->cfg.pointsPerFrame || ctx->cfg.residentPoints
+        || ctx->cfg.recordEveryFrame ? 0 : ctx->camera.version + 1;
+    if (stamp && r->stamps[index] == stamp) {
+        r->reused++;
+        return commandBuffer;
+    }
+
+    double start = nowMs();
+    r->stamps[index] = 0;
+    vkResetCommandBuffer(commandBuffer, 0);
+    if (!recordCommandBuffer(ctx, commandBuffer, imageIndex)) {
+        return VK_NULL_HANDLE;
+    }
+    r->stamps[index] = stamp;
+    r->recordMs += nowMs() - start;
+    r->recorded++;
+    return commandBuffer;
+}
+
+int recordSecondaries(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    recordState* r = &ctx->record;
+    r->image = imageIndex;
+    for (uint32_t i = 0; i < r->numWorkers; i++) {
+        sem_post(&r->workers[i].start);
+    }
+
+    int ok = true;
+    VkCommandBuffer secondaries[r->numWorkers];
+    for (uint32_t i = 0; i < r->numWorkers; i++) {
+        recordWorker* w = &r->workers[i];
+        while (sem_wait(&w->done) != 0 && errno == EINTR) {
+        }
+        ok = ok && w->ok;
+        secondaries[i] = w->buffers[ctx->currentFrame * r->numImages + imageIndex];
+    }
+    if (!ok) {
+        return false;
+    }
+    vkCmdExecuteCommands(commandBuffer, r->numWorkers, secondaries);
+    return true;
+}
+
+void recordReport(ctx* ctx) {
+    recordState* r = &ctx->record;
+    uint64_t frames = r->recorded + r->reused;
+    if (!frames) {
+        return;
+    }
+    double perRecording = r->recorded ? r->recordMs / r->recorded : 0.0;
+    fprintf(stdout, "record: %llu of %llu frames recorded, %.3f ms cpu each, "
+            "reuse saved %.3f ms per frame\n", (unsigned long long) r->recorded,
+            (unsigned long long) frames, perRecording,
+            perRecording * r->reused / frames);
+}
+
+void destroyRecording(ctx* ctx) {
+    recordState* r = &ctx->record;
+    freeBuffers(ctx);
+    for (uint32_t i = 0; i < r->numWorkers; i++) {
+        recordWorker* w = &r->workers[i];
+        if (w->started) {
+            w->quit = true;
+            sem_post(&w->start);
+            pthread_join(w->thread, NULL);
+        }
+        if (w->ctx) {
+            sem_destroy(&w->start);
+            sem_destroy(&w->done);
+        }
+        if (w->pool) { vkDestroyCommandPool(ctx->logicalDevice, w->pool, NULL); }
+    }
+    if (r->workers) { free(r->workers); }
+    memset(r, 0, sizeof(recordState));
+}
@@ -0,0 +1,40 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "vulkan.h"
+
+//frame command buffers are recorded once and submitted again until what
+//they draw changes. there is one per frame slot and swapchain image, since
+//a recording names both the slot's queries and ring slices and the image's
+//framebuffer. a recording stays valid while the camera version it was made
+//for is current, which recreateSwapchain bumps too. --progressive and
+//--resident-points draw something new every frame and always re-record,
+//as does --record always, which is there to measure what reuse saves.
+//
+//--record-threads N: the point set pass is recorded by N worker threads,
+//each into a secondary command buffer with its share of the draws, which
+//the frame then executes. it pays off once a pass has many draws, like
+//--resident-points without multiDrawIndirect
+
+//replaces per slot command buffers, needs the swapchain and command pools
+int createRecording(ctx* ctx);
+//the swapchain image count may have changed, every recording is stale
+int recreateRecording(ctx* ctx);
+
+//the command buffer to submit for the current frame slot and imageIndex,
+//recorded first if it's stale. VK_NULL_HANDLE on failure
+VkCommandBuffer frameCommandBuffer(ctx* ctx, uint32_t imageIndex);
+
+//inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS:
+//has the workers record their shares and executes them
+int recordSecondaries(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+//part of parts of n items, for splitting draws between workers
+void recordShare(uint32_t n, uint32_t part, uint32_t parts, uint32_t* first,
+        uint32_t* count);
+
+//recordings made and reused, and the cpu time reuse saved
+void recordReport(ctx* ctx);
+void destroyRecording(ctx* ctx);
+
+#endif
@@ -0,0 +1,277 @@
+#include "rng.h"
+#include <stdbool.h>
+#include <string.h>
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+//xoshiro256** (Blackman & Vigna)
+static inline uint64_t xoshiro_next(uint64_t* s) {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+//equivalent to 2^128 calls of xoshiro_next
+static void xoshiro_jump(uint64_t* s) {
+    static const uint64_t JUMP[] = {
+        0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+        0xa9582618e03fc9aa, 0x39abdc4529b1661c,
+    };
+    uint64_t t[4] = {0};
+    for (uint32_t i = 0; i < 4; i++) {
+        for (uint32_t b = 0; b < 64; b++) {
+            if (JUMP[i] & (1ull << b)) {
+                t[0] ^= s[0];
+                t[1] ^= s[1];
+                t[2] ^= s[2];
+                t[3] ^= s[3];
+            }
+            xoshiro_next(s);
+        }
+    }
+    memcpy(s, t, sizeof(t));
+}
+
+//pcg32, XSH-RR output (O'Neill)
+static inline uint32_t pcg_next(rng* r) {
+    uint64_t old = r->pcg.state;
+    r->pcg.state = old * 6364136223846793005ull + r->pcg.inc;
+    uint32_t xorshifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t) (old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+//philox4x32-10 (Salmon et al.), counter based so any position is O(1) away
+static void philox_block(rng* r) {
+    uint32_t c[4], k[2];
+    memcpy(c, r->philox.ctr, sizeof(c));
+    memcpy(k, r->philox.key, sizeof(k));
+    for (uint32_t round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t) 0xd2511f53u * c[0];
+        uint64_t p1 = (uint64_t) 0xcd9e8d57u * c[2];
+        uint32_t n0 = (uint32_t) (p1 >> 32) ^ c[1] ^ k[0];
+        uint32_t n2 = (uint32_t) (p0 >> 32) ^ c[3] ^ k[1];
+        c[0] = n0;
+        c[1] = (uint32_t) p1;
+        c[2] = n2;
+        c[3] = (uint32_t) p0;
+        k[0] += 0x9e3779b9u;
+        k[1] += 0xbb67ae85u;
+    }
+    memcpy(r->philox.out, c, sizeof(c));
+    r->philox.used = 0;
+
+    //the low 64 bits of the counter are the block index
+    if (++r->philox.ctr[0] == 0) {
+        r->philox.ctr[1]++;
+    }
+}
+
+static inline uint32_t philox_next(rng* r) {
+    if (r->philox.used == 4) {
+        philox_block(r);
+    }
+    return r->philox.out[r->philox.used++];
+}
+
+void rng_seed(rng* r, rng_kind kind, uint64_t seed, uint64_t stream) {
+    memset(r, 0, sizeof(rng));
+    r->kind = kind;
+    uint64_t sm = seed;
+    switch (kind) {
+        case RNG_XOSHIRO256SS:
+            for (uint32_t i = 0; i < 4; i++) {
+                r->xoshiro[i] = splitmix64(&sm);
+            }
+            for (uint64_t i = 0; i < stream; i++) {
+                xoshiro_jump(r->xoshiro);
+            }
+            break;
+        case RNG_PCG32:
+            r->pcg.inc = (stream << 1) | 1;
+            pcg_next(r);
+            r->pcg.state += splitmix64(&sm);
+            pcg_next(r);
+            break;
+        case RNG_PHILOX4X32:
+            r->philox.key[0] = (uint32_t) seed;
+            r->philox.key[1] = (uint32_t) (seed >> 32);
+            r->philox.ctr[2] = (uint32_t) stream;
+            r->philox.ctr[3] = (uint32_t) (stream >> 32);
+            r->philox.used = 4;
+            break;
+    }
+}
+
+uint64_t rng_next64(rng* r) {
+    switch (r->kind) {
+        case RNG_XOSHIRO256SS:
+            return xoshiro_next(r->xoshiro);
+        case RNG_PCG32: {
+            uint64_t hi = pcg_next(r);
+            return (hi << 32) | pcg_next(r);
+        }
+        case RNG_PHILOX4X32: {
+            uint64_t hi = philox_next(r);
+            return (hi << 32) | philox_next(r);
+        }
+    }
+    return 0;
+}
+
+uint32_t rng_next32(rng* r) {
+    switch (r->kind) {
+        case RNG_XOSHIRO256SS:
+            return (uint32_t) (xoshiro_next(r->xoshiro) >> 32);
+        case RNG_PCG32:
+            return pcg_next(r);
+        case RNG_PHILOX4X32:
+            return philox_next(r);
+    }
+    return 0;
+}
+
+void rng_skip(rng* r, uint64_t n) {
+    if (r->kind != RNG_PHILOX4X32) {
+        for (uint64_t i = 0; i < n; i++) {
+            rng_next64(r);
+        }
+        return;
+    }
+
+    //2n words from the current position: finish the current block, then
+    //jump whole blocks by bumping the counter
+    uint64_t words = 2 * n;
+    while (words && r->philox.used < 4) {
+        r->philox.used++;
+        words--;
+    }
+    uint64_t blocks = words / 4;
+    uint64_t ctr = ((uint64_t) r->philox.ctr[1] << 32) | r->philox.ctr[0];
+    ctr += blocks;
+    r->philox.ctr[0] = (uint32_t) ctr;
+    r->philox.ctr[1] = (uint32_t) (ctr >> 32);
+    for (uint64_t i = 0; i < words % 4; i++) {
+        philox_next(r);
+    }
+}
+
+//for the 3 choice case each byte of a draw holds four 2 bit fields. these
+//tables hold the accepted fields of every byte packed little endian, and
+//how many there were, so a draw is consumed 4 fields per step
+static uint32_t choice3Packed[256];
+static uint8_t choice3Count[256];
+
+__attribute__((constructor))
+static void build_choice3_tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t packed = 0;
+        uint8_t count = 0;
+        for (uint32_t f = 0; f < 4; f++) {
+            uint32_t v = (b >> (2 * f)) & 3;
+            if (v < 3) {
+                packed |= v << (8 * count);
+                count++;
+            }
+        }
+        choice3Packed[b] = packed;
+        choice3Count[b] = count;
+    }
+}
+
+static void fill_choices3(rng* r, uint8_t* out, size_t n) {
+    size_t i = 0;
+    //every byte stores 4 bytes at out + i, so keep a full draw of slack
+    while (i + 32 <= n) {
+        uint64_t w = rng_next64(r);
+        for (uint32_t byte = 0; byte < 8; byte++) {
+            uint32_t b = (uint32_t) (w & 0xff);
+            memcpy(out + i, &choice3Packed[b], sizeof(uint32_t));
+            i += choice3Count[b];
+            w >>= 8;
+        }
+    }
+    while (i < n) {
+        uint64_t w = rng_next64(r);
+        for (uint32_t f = 0; f < 32 && i < n; f++) {
+            uint8_t v = (uint8_t) (w & 3);
+            if (v < 3) {
+                out[i++] = v;
+            }
+            w >>= 2;
+        }
+    }
+}
+
+void rng_fill_choices(rng* r, uint8_t* out, size_t n, uint32_t numChoices) {
+    if (numChoices <= 1) {
+        memset(out, 0, n);
+        return;
+    }
+    if (numChoices == 3) {
+        fill_choices3(r, out, n);
+        return;
+    }
+
+    uint32_t bits = 32 - __builtin_clz(numChoices - 1);
+    uint64_t mask = (1ull << bits) - 1;
+    uint32_t fields = 64 / bits;
+
+    //while a whole draw's worth of fields fits, store unconditionally and
+    //only advance on accepted values. no data dependent branch
+    size_t i = 0;
+    while (i + fields <= n) {
+        uint64_t w = rng_next64(r);
+        for (uint32_t f = 0; f < fields; f++) {
+            uint8_t v = (uint8_t) (w & mask);
+            out[i] = v;
+            i += v < numChoices;
+            w >>= bits;
+        }
+    }
+    while (i < n) {
+        uint64_t w = rng_next64(r);
+        for (uint32_t f = 0; f < fields && i < n; f++) {
+            uint8_t v = (uint8_t) (w & mask);
+            if (v < numChoices) {
+                out[i++] = v;
+            }
+            w >>= bits;
+        }
+    }
+}
+
+static const char* kindNames[] = {
+    [RNG_XOSHIRO256SS] = "xoshiro",
+    [RNG_PCG32] = "pcg",
+    [RNG_PHILOX4X32] = "philox",
+};
+
+int rng_parse_kind(const char* name, rng_kind* kind) {
+    for (uint32_t i = 0; i < sizeof(kindNames) / sizeof(kindNames[0]); i++) {
+        if (strcmp(name, kindNames[i]) == 0) {
+            *kind = (rng_kind) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* rng_kind_name(rng_kind kind) {
+    return kindNames[kind];
+}
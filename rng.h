@@ -0,0 +1,53 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum rng_kind {
+    RNG_XOSHIRO256SS = 0,
+    RNG_PCG32,
+    RNG_PHILOX4X32,
+} rng_kind;
+
+//one independent generator stream. not thread safe, give every thread its own
+typedef struct rng {
+    rng_kind kind;
+    union {
+        uint64_t xoshiro[4];
+        struct {
+            uint64_t state;
+            uint64_t inc;
+        } pcg;
+        struct {
+            uint32_t ctr[4];
+            uint32_t key[2];
+            uint32_t out[4];
+            uint32_t used;
+        } philox;
+    };
+} rng;
+
+//the same (kind, seed, stream) triple always produces the same sequence and
+//different streams of one seed don't overlap:
+//  xoshiro256**: stream jumps of 2^128
+//  pcg32: stream selects the increment
+//  philox4x32-10: stream is the high half of the counter
+void rng_seed(rng* r, rng_kind kind, uint64_t seed, uint64_t stream);
+
+uint64_t rng_next64(rng* r);
+uint32_t rng_next32(rng* r);
+
+//advance by n 64 bit outputs. O(1) for philox, O(n) otherwise
+void rng_skip(rng* r, uint64_t n);
+
+//fill out[0..n) with uniform values in [0, numChoices), numChoices <= 256.
+//each 64 bit draw is split into as many ceil(log2(numChoices)) bit fields as
+//fit and out of range fields are rejected, so for the gasket's 3 choices one
+//draw yields ~24 indices instead of one modulo per index
+void rng_fill_choices(rng* r, uint8_t* out, size_t n, uint32_t numChoices);
+
+int rng_parse_kind(const char* name, rng_kind* kind);
+const char* rng_kind_name(rng_kind kind);
+
+#endif
@@ -0,0 +1,228 @@
+#version 450
+
+//one invocation is one chaos game walker of the ifs in the Maps buffer.
+//walker w of a dispatch writes the points base + k * walkers + w, so a
+//warp's stores for one step are adjacent.
+//with HISTOGRAM set the points are binned into a density histogram instead.
+//either way the dispatch adds what it wrote to the vertexCount of
+//draws[drawSlot], so the draw that follows is an indirect one and the host
+//never needs the count. with CULL set only the points inside the view are
+//kept, appended in whatever order the workgroups get there
+
+layout(local_size_x = 64) in;
+
+layout(constant_id = 0) const bool HISTOGRAM = false;
+//write PackedVertex (2 words) instead of Vertex (5 words)
+layout(constant_id = 1) const bool PACKED = false;
+layout(constant_id = 2) const bool CULL = false;
+
+//points: Vertex as the host sees it, vec2 pos, vec3 color, tightly packed.
+//std430 would pad a vec3 member to 16 bytes, so it's addressed as words.
+//PackedVertex is a snorm16x2 word followed by an unorm8x4 word.
+//histogram: a 4 word header whose first word is the running max hit count
+//(to within 2x), then 4 words per pixel: hits, red, green and blue sums in
+//1/HIST_COLOR_STEPS steps
+layout(std430, set = 0, binding = 0) buffer Data {
+    uint data[];
+};
+
+const uint HIST_HEADER = 4;
+//CHAOS_HIST_COLOR_STEPS, see chaos.h
+const float HIST_COLOR_STEPS = 15.0;
+
+//gpugenIfs: the maps and their alias table, see ifs.h
+struct Map {
+    vec4 linear;
+    vec2 offset;
+    uint threshold;
+    uint alias;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Maps {
+    uint numMaps;
+    uint burnIn;
+    uint weighted;
+    uint pad;
+    Map maps[16];
+};
+
+//VkDrawIndirectCommand, zeroed by the host before the first dispatch
+struct DrawCommand {
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 2) buffer Draws {
+    DrawCommand draws[];
+};
+
+layout(push_constant) uniform Params {
+    uint seedLo;
+    uint seedHi;
+    uint base;
+    uint count;
+    uint walkers;
+    uint firstWalker;
+    uint width;
+    uint height;
+    uint drawSlot;
+    uint pad;
+    //CULL: the view as vertexParams has it, (pos - center) * zoom, and the
+    //ndc bound a point has to be inside of, 1 plus a pixel
+    vec2 center;
+    vec2 zoom;
+    vec2 bound;
+} params;
+
+//CULL: points kept by the group this step, then where they go
+shared uint groupKept;
+shared uint groupBase;
+
+//per walker generator state, the walker id picks the pcg stream
+uint state;
+uint inc;
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+//32 bit pcg, rxs-m-xs output. keeps the shader free of int64, which not
+//every driver exposes
+uint nextRandom() {
+    uint old = state;
+    state = old * 747796405u + inc;
+    uint word = ((old >> ((old >> 28u) + 4u)) ^ old) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+//column from the high word of r * numMaps, unbiased to within 2^-32. a
+//weighted ifs then flips a 16 bit coin between the column and its alias
+uint nextChoice() {
+    uint hi, lo;
+    umulExtended(nextRandom(), numMaps, hi, lo);
+    if (weighted != 0u && (nextRandom() >> 16u) >= maps[hi].threshold) {
+        return maps[hi].alias;
+    }
+    return hi;
+}
+
+void iterate(inout vec2 pos, inout vec3 color) {
+    Map m = maps[nextChoice()];
+    pos = vec2(m.linear.x * pos.x + m.linear.y * pos.y,
+            m.linear.z * pos.x + m.linear.w * pos.y) + m.offset;
+    color = (color + m.color.rgb) * 0.5;
+}
+
+void store(uint index, vec2 pos, vec3 color) {
+    if (PACKED) {
+        uint o = index * 2u;
+        data[o + 0] = packSnorm2x16(pos);
+        data[o + 1] = packUnorm4x8(vec4(color, 1.0));
+        return;
+    }
+
+    uint o = index * 5u;
+    data[o + 0] = floatBitsToUint(pos.x);
+    data[o + 1] = floatBitsToUint(pos.y);
+    data[o + 2] = floatBitsToUint(color.r);
+    data[o + 3] = floatBitsToUint(color.g);
+    data[o + 4] = floatBitsToUint(color.b);
+}
+
+//one global atomic per group and step instead of one per point. every
+//invocation of the group has to get here, live or not
+void append(bool keep, vec2 pos, vec3 color) {
+    if (gl_LocalInvocationIndex == 0u) {
+        groupKept = 0u;
+    }
+    barrier();
+    uint local = 0u;
+    if (keep) {
+        local = atomicAdd(groupKept, 1u);
+    }
+    barrier();
+    if (gl_LocalInvocationIndex == 0u && groupKept != 0u) {
+        groupBase = atomicAdd(draws[params.drawSlot].vertexCount, groupKept);
+    }
+    barrier();
+    if (keep) {
+        store(params.base + groupBase + local, pos, color);
+    }
+}
+
+void bin(vec2 pos, vec3 color) {
+    //same mapping as the rasterizer and chaos_histogram()
+    uvec2 size = uvec2(params.width, params.height);
+    uvec2 p = uvec2(clamp(ivec2((pos + 1.0) * 0.5 * vec2(size)), ivec2(0),
+                ivec2(size) - 1));
+    uint o = HIST_HEADER + (p.y * params.width + p.x) * 4u;
+    uint hits = atomicAdd(data[o], 1u) + 1u;
+    uvec3 c = uvec3(color * HIST_COLOR_STEPS + 0.5);
+    atomicAdd(data[o + 1], c.r);
+    atomicAdd(data[o + 2], c.g);
+    atomicAdd(data[o + 3], c.b);
+
+    //only on powers of two, so the shared max word is touched
+    //log2(hits) times per pixel instead of once per point
+    if ((hits & (hits - 1u)) == 0u) {
+        atomicMax(data[0], hits);
+    }
+}
+
+void main() {
+    uint walker = gl_GlobalInvocationID.x;
+    //the barriers in append() need the whole group, so with CULL the
+    //invocations past the last walker run along without a walker
+    bool live = walker < params.walkers;
+    if (!live && !CULL) {
+        return;
+    }
+
+    uint id = params.firstWalker + walker;
+    inc = (hash(id ^ params.seedHi) << 1u) | 1u;
+    state = hash(params.seedLo + hash(id));
+
+    vec2 pos = vec2(0.0);
+    vec3 color = vec3(0.0);
+    if (live) {
+        for (uint k = 0; k < burnIn; k++) {
+            iterate(pos, color);
+        }
+    }
+
+    if (CULL) {
+        //the same number of steps for every invocation, so none of them
+        //leaves the loop while the others wait at a barrier
+        uint steps = (params.count + params.walkers - 1u) / params.walkers;
+        for (uint k = 0; k < steps; k++) {
+            bool active = live && walker + k * params.walkers < params.count;
+            if (active) {
+                iterate(pos, color);
+            }
+            vec2 ndc = abs((pos - params.center) * params.zoom);
+            append(active && all(lessThanEqual(ndc, params.bound)), pos, color);
+        }
+        return;
+    }
+
+    if (walker == 0u && !HISTOGRAM) {
+        atomicAdd(draws[params.drawSlot].vertexCount, params.count);
+    }
+
+    for (uint i = walker; i < params.count; i += params.walkers) {
+        iterate(pos, color);
+        if (HISTOGRAM) {
+            bin(pos, color);
+        } else {
+            store(params.base + i, pos, color);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#version 450
+
+//--render instanced: the vertex buffer only holds the gasket's outer
+//triangle. instance i is the sub-triangle whose base 3 digits, least
+//significant first, pick the corner each level moves halfway towards, so
+//3^depth instances cover the depth level gasket with O(1) vertex memory
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+
+//vertexParams in vulkan.h, the camera and the number of digits
+layout(push_constant) uniform Params {
+    vec2 center;
+    vec2 zoom;
+    uint depth;
+} params;
+
+//the gasket preset's corners and colors, see ifs.c
+const vec2 corners[3] = vec2[](vec2(0.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+const vec3 colors[3] = vec3[](vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0));
+
+void main() {
+    vec2 pos = inPosition;
+    vec3 color = inColor;
+    uint digits = uint(gl_InstanceIndex);
+    for (uint k = 0; k < params.depth; k++) {
+        uint d = digits % 3u;
+        digits /= 3u;
+        pos = (pos + corners[d]) * 0.5;
+        color = (color + colors[d]) * 0.5;
+    }
+
+    gl_Position = vec4((pos - params.center) * params.zoom, 0.0, 1.0);
+    fragColor = color;
+}
@@ -0,0 +1,10 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+
+//the progressive accumulation image, the same size as the target
+layout(set = 0, binding = 0) uniform sampler2D accum;
+
+void main() {
+    outColor = texelFetch(accum, ivec2(gl_FragCoord.xy), 0);
+}
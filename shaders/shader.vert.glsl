@@ -5,8 +5,15 @@ layout(location = 1) in vec3 inColor;
 
 layout(location = 0) out vec3 fragColor;
 
+//vertexParams in vulkan.h, the camera
+layout(push_constant) uniform Params {
+    vec2 center;
+    vec2 zoom;
+    uint depth;
+} params;
+
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
+    gl_Position = vec4((inPosition - params.center) * params.zoom, 0.0, 1.0);
     fragColor = inColor;
     gl_PointSize = 2.0f;
 }
@@ -0,0 +1,43 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+
+//4 word header whose first word is the max hit count of any pixel, then 4
+//words per pixel: hits, red, green and blue sums, see HIST_COLOR_STEPS
+layout(std430, set = 0, binding = 0) readonly buffer Histogram {
+    uint data[];
+};
+
+layout(push_constant) uniform Params {
+    uint width;
+    uint height;
+    uint targetWidth;
+    uint targetHeight;
+    float gamma;
+} params;
+
+const uint HIST_HEADER = 4;
+//CHAOS_HIST_COLOR_STEPS, see chaos.h
+const float HIST_COLOR_STEPS = 15.0;
+
+void main() {
+    //the histogram keeps the size it was binned at, stretch it to the target
+    uvec2 p = uvec2(gl_FragCoord.xy * vec2(params.width, params.height)
+            / vec2(params.targetWidth, params.targetHeight));
+    p = min(p, uvec2(params.width, params.height) - 1u);
+
+    uint o = HIST_HEADER + (p.y * params.width + p.x) * 4u;
+    uint hits = data[o];
+    if (hits == 0u) {
+        outColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    //log density keeps the sparse outer triangles visible next to the dense
+    //corners, gamma then lifts the mid tones
+    float maxHits = max(float(data[0]), 1.0);
+    float alpha = clamp(log(1.0 + float(hits)) / log(1.0 + maxHits), 0.0, 1.0);
+    vec3 color = vec3(data[o + 1], data[o + 2], data[o + 3])
+        / (HIST_COLOR_STEPS * float(hits));
+    outColor = vec4(color * pow(alpha, 1.0 / params.gamma), 1.0);
+}
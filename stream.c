@@ -0,0 +1,293 @@
+#include "stream.h"
+#include "arena.h"
+#include "record.h"
+#include "upload.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int streamWantsMultiDraw(ctx* ctx) {
+    if (!ctx->cfg.residentPoints) {
+        return false;
+    }
+
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(ctx->physicalDevice, &supported);
+    return supported.multiDrawIndirect == VK_TRUE;
+}
+
+int createStream(ctx* ctx) {
+    streamState* s = &ctx->stream;
+    const point_file_header* header = ctx->pointFile.header;
+    //streaming is in whole chunks, a file without them can't be streamed
+    if (!header->chunkPoints || !header->count) {
+        fprintf(stderr, "ERROR: Point file has no chunks to stream\n");
+        return false;
+    }
+    s->chunkPoints = header->chunkPoints;
+    s->numChunks = (header->count + s->chunkPoints - 1) / s->chunkPoints;
+
+    uint64_t resident = ctx->cfg.residentPoints < header->count ? ctx->cfg.residentPoints
+        : header->count;
+    s->numSlots = (uint32_t) ((resident + s->chunkPoints - 1) / s->chunkPoints);
+    //firstVertex of the last slot has to fit 32 bits
+    while ((uint64_t) s->numSlots * s->chunkPoints > UINT32_MAX) {
+        s->numSlots--;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->physicalDevice, &props);
+    s->multiDraw = streamWantsMultiDraw(ctx)
+        && props.limits.maxDrawIndirectCount >= s->numSlots;
+
+    s->chunks = calloc(s->numChunks, sizeof(streamChunk));
+    s->slotChunk = malloc(s->numSlots * sizeof(int64_t));
+    s->slotDraws = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(uint32_t));
+    if (!s->chunks || !s->slotChunk || !s->slotDraws) {
+        fprintf(stderr, "ERROR: Couldn't allocate point stream state\n");
+        return false;
+    }
+    for (uint64_t i = 0; i < s->numChunks; i++) {
+        uint64_t first = i * s->chunkPoints;
+        s->chunks[i].slot = -1;
+        s->chunks[i].count = (uint32_t) (header->count - first < s->chunkPoints
+                ? header->count - first : s->chunkPoints);
+    }
+    for (uint32_t i = 0; i < s->numSlots; i++) {
+        s->slotChunk[i] = -1;
+    }
+
+    //chunks are decoded straight into the pool where the cpu can write it,
+    //otherwise through staging buffers on the transfer queue
+    VkDeviceSize poolSize = (VkDeviceSize) s->numSlots * s->chunkPoints * vertexStride(ctx);
+    VkMemoryPropertyFlags poolProps = ctx->unifiedMemory
+        ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (!createBuffer(ctx, poolSize,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                poolProps, &s->pool, &s->poolMemory)) {
+        fprintf(stderr, "ERROR: Couldn't create the resident point pool\n");
+        return false;
+    }
+
+    //rewritten every frame, like the lod ring
+    VkDeviceSize drawSize = (VkDeviceSize) ctx->MAX_FRAMES_IN_FLIGHT * s->numSlots
+        * sizeof(VkDrawIndirectCommand);
+    if (!createBuffer(ctx, drawSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &s->drawBuffer, &s->drawMemory)) {
+        fprintf(stderr, "ERROR: Couldn't create the point stream draw buffer\n");
+        return false;
+    }
+
+    //every resident point at most
+    ctx->benchVertices = s->numSlots * s->chunkPoints;
+    fprintf(stdout, "stream: %llu chunks of %u points, %u resident (%.1f MB), %s\n",
+            (unsigned long long) s->numChunks, s->chunkPoints, s->numSlots,
+            poolSize / 1048576.0, s->multiDraw ? "multi draw indirect" : "one draw per chunk");
+    return true;
+}
+
+static void viewBounds(ctx* ctx, double lo[2], double hi[2]) {
+    cameraState* c = &ctx->camera;
+    for (int k = 0; k < 2; k++) {
+        double zoom = c->zoom * c->regionScale[k];
+        double center = c->center[k] + c->regionOffset[k] / c->zoom;
+        lo[k] = center - 1.0 / zoom;
+        hi[k] = center + 1.0 / zoom;
+    }
+}
+
+static int visible(const streamChunk* chunk, const double lo[2], const double hi[2]) {
+    return !chunk->hasBounds || (chunk->max[0] >= lo[0] && chunk->min[0] <= hi[0]
+            && chunk->max[1] >= lo[1] && chunk->min[1] <= hi[1]);
+}
+
+//a free slot, or the least recently used one no frame in flight draws
+static int32_t findSlot(ctx* ctx) {
+    streamState* s = &ctx->stream;
+    int32_t best = -1;
+    uint64_t bestUsed = UINT64_MAX;
+    for (uint32_t i = 0; i < s->numSlots; i++) {
+        if (s->slotChunk[i] < 0) {
+            return (int32_t) i;
+        }
+        uint64_t used = s->chunks[s->slotChunk[i]].lastUsed;
+        if (used + ctx->MAX_FRAMES_IN_FLIGHT <= s->frame && used < bestUsed) {
+            best = (int32_t) i;
+            bestUsed = used;
+        }
+    }
+    if (best >= 0) {
+        s->chunks[s->slotChunk[best]].slot = -1;
+        s->evictions++;
+    }
+    return best;
+}
+
+static void chunkBounds(ctx* ctx, streamChunk* chunk, const void* points) {
+    float lo[2] = { 1e30f, 1e30f };
+    float hi[2] = { -1e30f, -1e30f };
+    for (uint32_t i = 0; i < chunk->count; i++) {
+        float pos[2];
+        if (ctx->cfg.packedVertices) {
+            const PackedVertex* p = (const PackedVertex*) points + i;
+            pos[0] = p->pos[0] / 32767.0f;
+            pos[1] = p->pos[1] / 32767.0f;
+        } else {
+            const Vertex* v = (const Vertex*) points + i;
+            pos[0] = v->pos[0];
+            pos[1] = v->pos[1];
+        }
+        for (int k = 0; k < 2; k++) {
+            lo[k] = pos[k] < lo[k] ? pos[k] : lo[k];
+            hi[k] = pos[k] > hi[k] ? pos[k] : hi[k];
+        }
+    }
+    memcpy(chunk->min, lo, sizeof(lo));
+    memcpy(chunk->max, hi, sizeof(hi));
+    chunk->hasBounds = true;
+}
+
+static int decode(ctx* ctx, uint64_t index, void* dst) {
+    streamState* s = &ctx->stream;
+    uint64_t first = index * s->chunkPoints;
+    uint32_t count = s->chunks[index].count;
+    if (ctx->cfg.packedVertices) {
+        return point_file_read_packed(&ctx->pointFile, first, count, dst);
+    }
+    return point_file_read(&ctx->pointFile, first, count, dst);
+}
+
+static int loadChunk(ctx* ctx, uint64_t index, int32_t slot) {
+    streamState* s = &ctx->stream;
+    streamChunk* chunk = &s->chunks[index];
+    VkDeviceSize size = (VkDeviceSize) chunk->count * vertexStride(ctx);
+    VkDeviceSize offset = (VkDeviceSize) slot * s->chunkPoints * vertexStride(ctx);
+
+    if (ctx->unifiedMemory) {
+        void* dst = (uint8_t*) s->poolMemory.mapped + offset;
+        if (!decode(ctx, index, dst)) {
+            return false;
+        }
+        chunkBounds(ctx, chunk, dst);
+    } else {
+        VkBuffer staging;
+        memAlloc stagingMemory;
+        if (!createBuffer(ctx, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    &staging, &stagingMemory)) {
+            return false;
+        }
+        if (!decode(ctx, index, stagingMemory.mapped)
+                || !uploadCopy(ctx, staging, 0, s->pool, offset, size,
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)) {
+            vkDestroyBuffer(ctx->logicalDevice, staging, NULL);
+            arenaFree(ctx, &stagingMemory);
+            return false;
+        }
+        chunkBounds(ctx, chunk, stagingMemory.mapped);
+        if (!uploadRetire(ctx, staging, &stagingMemory)) {
+            return false;
+        }
+    }
+
+    chunk->slot = slot;
+    s->slotChunk[slot] = (int64_t) index;
+    s->loads++;
+    s->bytes += size;
+    return true;
+}
+
+int streamUpdate(ctx* ctx) {
+    streamState* s = &ctx->stream;
+    uint32_t frameSlot = ctx->currentFrame;
+    VkDrawIndirectCommand* draws = (VkDrawIndirectCommand*) s->drawMemory.mapped
+        + (uint64_t) frameSlot * s->numSlots;
+    uint32_t numDraws = 0;
+    uint32_t budget = ctx->cfg.headlessOutput ? UINT32_MAX : STREAM_LOADS_PER_FRAME;
+    s->frame++;
+
+    double lo[2], hi[2];
+    viewBounds(ctx, lo, hi);
+    for (uint64_t i = 0; i < s->numChunks; i++) {
+        streamChunk* chunk = &s->chunks[i];
+        if (!visible(chunk, lo, hi)) {
+            continue;
+        }
+        if (chunk->slot < 0) {
+            int32_t slot = budget ? findSlot(ctx) : -1;
+            if (slot < 0) {
+                continue;
+            }
+            if (!loadChunk(ctx, i, slot)) {
+                fprintf(stderr, "ERROR: Couldn't load point chunk %llu\n",
+                        (unsigned long long) i);
+                return false;
+            }
+            budget--;
+            //not drawn, but its copy is in flight and the slot can't be reused
+            //before the next frames
+            chunk->lastUsed = s->frame;
+            //first read, the bounds may say it's out of view after all
+            if (!visible(chunk, lo, hi)) {
+                continue;
+            }
+        }
+
+        chunk->lastUsed = s->frame;
+        draws[numDraws++] = (VkDrawIndirectCommand) {
+            .vertexCount = chunk->count,
+            .instanceCount = 1,
+            .firstVertex = (uint32_t) chunk->slot * s->chunkPoints,
+            .firstInstance = 0,
+        };
+    }
+    s->slotDraws[frameSlot] = numDraws;
+    return true;
+}
+
+void recordStream(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t part, uint32_t parts) {
+    streamState* s = &ctx->stream;
+    uint32_t frameSlot = ctx->currentFrame;
+    uint32_t firstDraw, numDraws;
+    recordShare(s->slotDraws[frameSlot], part, parts, &firstDraw, &numDraws);
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &s->pool, &offset);
+    if (!numDraws) {
+        return;
+    }
+
+    uint64_t first = (uint64_t) frameSlot * s->numSlots + firstDraw;
+    if (s->multiDraw) {
+        vkCmdDrawIndirect(commandBuffer, s->drawBuffer,
+                first * sizeof(VkDrawIndirectCommand), numDraws,
+                sizeof(VkDrawIndirectCommand));
+        return;
+    }
+    const VkDrawIndirectCommand* draws = (const VkDrawIndirectCommand*) s->drawMemory.mapped
+        + first;
+    for (uint32_t i = 0; i < numDraws; i++) {
+        vkCmdDraw(commandBuffer, draws[i].vertexCount, 1, draws[i].firstVertex, 0);
+    }
+}
+
+void streamReport(ctx* ctx) {
+    streamState* s = &ctx->stream;
+    fprintf(stdout, "stream: %llu chunk loads (%.1f MB), %llu evictions over %llu frames\n",
+            (unsigned long long) s->loads, s->bytes / 1048576.0,
+            (unsigned long long) s->evictions, (unsigned long long) s->frame);
+}
+
+void destroyStream(ctx* ctx) {
+    streamState* s = &ctx->stream;
+    if (s->pool) { vkDestroyBuffer(ctx->logicalDevice, s->pool, NULL); }
+    arenaFree(ctx, &s->poolMemory);
+    if (s->drawBuffer) { vkDestroyBuffer(ctx->logicalDevice, s->drawBuffer, NULL); }
+    arenaFree(ctx, &s->drawMemory);
+    free(s->chunks);
+    free(s->slotChunk);
+    free(s->slotDraws);
+}
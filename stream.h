@@ -0,0 +1,37 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "vulkan.h"
+
+//--resident-points N with --load-points FILE: point files larger than gpu
+//memory. the file is split into its own chunks (chunkPoints of the header)
+//and at most N points worth of them are resident, in slots of one device
+//local pool buffer. every frame the chunks whose bounds overlap the view are
+//drawn if resident and loaded if not, a few per frame in a window so the
+//frame rate stays put while the view fills in, replacing the least recently
+//drawn chunks once the pool is full. a chunk still drawn by a frame in
+//flight is never replaced, so when more is visible than fits the resident
+//set stays as is instead of thrashing. resident chunks are drawn with one
+//multi draw indirect, or a vkCmdDraw each without multiDrawIndirect
+
+//chunks loaded per frame with a window. --headless loads everything visible
+//that fits before each frame, its frames are written out
+#define STREAM_LOADS_PER_FRAME 8
+
+//true if the device should be created with multiDrawIndirect
+int streamWantsMultiDraw(ctx* ctx);
+
+//pool and draw buffers, sets benchVertices to the resident capacity.
+//replaces createVertexBuffer
+int createStream(ctx* ctx);
+
+//call once the current slot's fence has signalled, before recording
+int streamUpdate(ctx* ctx);
+//part of parts of the draws, see --record-threads
+void recordStream(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t part, uint32_t parts);
+
+//chunk loads and evictions over the run
+void streamReport(ctx* ctx);
+void destroyStream(ctx* ctx);
+
+#endif
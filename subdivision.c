@@ -0,0 +1,115 @@
+#include "subdivision.h"
+#include <stddef.h>
+
+//vertices are numbered level by level: the 3 corners, then the 3^l edge
+//midpoints that level l adds (3 per triangle of level l - 1). level l's block
+//starts at 3 + 3 + 9 + ... + 3^(l-1) = (3^l + 3) / 2, so every vertex index
+//follows from the level and the triangle that adds it and nothing has to be
+//deduplicated. levelStart[depth + 1] is the vertex count of the whole depth
+#define LEVEL_START(pow3) (((pow3) + 3u) / 2u)
+
+static const uint32_t pow3[SUBDIV_MAX_DEPTH + 2] = {
+    1u, 3u, 9u, 27u, 81u, 243u, 729u, 2187u, 6561u, 19683u, 59049u, 177147u,
+    531441u, 1594323u, 4782969u, 14348907u, 43046721u,
+};
+
+static const uint32_t levelStart[SUBDIV_MAX_DEPTH + 2] = {
+    0u, LEVEL_START(3u), LEVEL_START(9u), LEVEL_START(27u), LEVEL_START(81u),
+    LEVEL_START(243u), LEVEL_START(729u), LEVEL_START(2187u), LEVEL_START(6561u),
+    LEVEL_START(19683u), LEVEL_START(59049u), LEVEL_START(177147u),
+    LEVEL_START(531441u), LEVEL_START(1594323u), LEVEL_START(4782969u),
+    LEVEL_START(14348907u), LEVEL_START(43046721u),
+};
+
+_Static_assert(LEVEL_START(3u) == 3u, "the corners are the whole depth 0 gasket");
+_Static_assert(3ull * 14348907u <= UINT32_MAX, "indices of the deepest level fit 32 bits");
+
+typedef struct corner {
+    uint32_t index;
+    float pos[2];
+    float color[3];
+} corner;
+
+typedef struct subdivision {
+    uint32_t depth;
+    int packed;
+    void* vertices;
+    uint32_t* indices;
+} subdivision;
+
+uint32_t subdivision_vertex_count(uint32_t depth) {
+    return levelStart[depth + 1];
+}
+
+uint32_t subdivision_index_count(uint32_t depth) {
+    return 3 * pow3[depth];
+}
+
+static void emit(const subdivision* s, const corner* c) {
+    if (!s->vertices) {
+        return;
+    }
+    if (s->packed) {
+        ((PackedVertex*) s->vertices)[c->index] = packVertex(c->pos[0], c->pos[1],
+                c->color[0], c->color[1], c->color[2]);
+        return;
+    }
+    Vertex* v = (Vertex*) s->vertices + c->index;
+    v->pos[0] = c->pos[0];
+    v->pos[1] = c->pos[1];
+    v->color[0] = c->color[0];
+    v->color[1] = c->color[1];
+    v->color[2] = c->color[2];
+}
+
+static corner midpoint(const corner* a, const corner* b, uint32_t index) {
+    corner m = { index, {}, {} };
+    for (int k = 0; k < 2; k++) {
+        m.pos[k] = (a->pos[k] + b->pos[k]) * 0.5f;
+    }
+    for (int k = 0; k < 3; k++) {
+        m.color[k] = (a->color[k] + b->color[k]) * 0.5f;
+    }
+    return m;
+}
+
+//triangle t of level has children 3t, 3t + 1 and 3t + 2 on the next level,
+//one per corner, so a leaf's indices go to 3t of the index buffer
+static void subdivide(const subdivision* s, uint32_t level, uint32_t t, const corner* a,
+        const corner* b, const corner* c) {
+    if (level == s->depth) {
+        if (s->indices) {
+            s->indices[3 * t + 0] = a->index;
+            s->indices[3 * t + 1] = b->index;
+            s->indices[3 * t + 2] = c->index;
+        }
+        return;
+    }
+
+    uint32_t first = levelStart[level + 1] + 3 * t;
+    corner ab = midpoint(a, b, first + 0);
+    corner bc = midpoint(b, c, first + 1);
+    corner ca = midpoint(c, a, first + 2);
+    emit(s, &ab);
+    emit(s, &bc);
+    emit(s, &ca);
+
+    subdivide(s, level + 1, 3 * t + 0, a, &ab, &ca);
+    subdivide(s, level + 1, 3 * t + 1, &ab, b, &bc);
+    subdivide(s, level + 1, 3 * t + 2, &ca, &bc, c);
+}
+
+void subdivide_gasket(uint32_t depth, int packed, void* vertices, uint32_t* indices) {
+    subdivision s = { depth, packed, vertices, indices };
+
+    //the gasket preset's corners and colors, see ifs.c
+    corner corners[3] = {
+        { 0, { 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f } },
+        { 1, { 1.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } },
+        { 2, { -1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f } },
+    };
+    for (uint32_t i = 0; i < 3; i++) {
+        emit(&s, &corners[i]);
+    }
+    subdivide(&s, 0, 0, &corners[0], &corners[1], &corners[2]);
+}
@@ -0,0 +1,30 @@
+#ifndef SUBDIVISION_H
+#define SUBDIVISION_H
+
+#include <stdint.h>
+#include "vertex.h"
+
+//--render subdivision: the depth k gasket as 3^k filled triangles instead of
+//a cloud of chaos game points. no randomness and no gaps, every pixel the
+//gasket covers at that depth is drawn exactly once
+
+//3^15 triangles is ~172 MB of indices, deeper is below pixel size anyway
+#define SUBDIV_MAX_DEPTH 15
+//--render instanced needs no memory per triangle, the limit is 3 vertices
+//per instance still fitting a 32 bit vertex count
+#define INSTANCED_MAX_DEPTH 19
+
+//distinct vertices, (3^(depth + 1) + 3) / 2. triangles of the same depth
+//only ever share corners, which are stored once
+uint32_t subdivision_vertex_count(uint32_t depth);
+//3 per triangle
+uint32_t subdivision_index_count(uint32_t depth);
+
+//writes the vertices (Vertex, or PackedVertex when packed) and/or the
+//triangle list indices, either may be NULL. the numbering only depends on
+//depth, so both can be generated in separate passes straight into mapped
+//buffers. colors are the corners' colors interpolated the way the chaos
+//game mixes them, so both renderers agree
+void subdivide_gasket(uint32_t depth, int packed, void* vertices, uint32_t* indices);
+
+#endif
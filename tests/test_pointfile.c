@@ -0,0 +1,125 @@
+//point files with a bad header have to be refused on open, not crash a load
+//or a stream later
+#include "../pointfile.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static const char* path = "tests/test_pointfile.pts";
+
+static int writeFile(const point_file_header* header, uint64_t records, size_t record) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        return 0;
+    }
+    uint8_t page[POINT_FILE_HEADER_SIZE] = { 0 };
+    memcpy(page, header, sizeof(point_file_header));
+    fwrite(page, 1, sizeof(page), f);
+    uint8_t zero[20] = { 0 };
+    for (uint64_t i = 0; i < records; i++) {
+        fwrite(zero, 1, record, f);
+    }
+    return fclose(f) == 0;
+}
+
+//the header as written, with records that match its count
+static int opens(const point_file_header* header) {
+    size_t record = point_record_size(header->layout);
+    CHECK(writeFile(header, header->count, record));
+    point_file f;
+    int ok = point_file_open(&f, path);
+    if (ok) {
+        point_file_close(&f);
+    }
+    return ok;
+}
+
+int main() {
+    point_file_header good = {
+        .magic = POINT_FILE_MAGIC,
+        .version = POINT_FILE_VERSION,
+        .layout = POINT_F32,
+        .count = 1000,
+        .chunkPoints = POINT_FILE_CHUNK,
+    };
+    CHECK(opens(&good));
+
+    point_file_header h = good;
+    h.chunkPoints = 0;
+    CHECK(!opens(&h));
+
+    //100 f32 records are 2000 bytes, chunks would start mid page
+    h = good;
+    h.chunkPoints = 100;
+    CHECK(!opens(&h));
+
+    //1024 records are whole pages for every layout
+    h = good;
+    h.chunkPoints = 1024;
+    CHECK(opens(&h));
+    h.layout = POINT_U16;
+    CHECK(opens(&h));
+
+    h = good;
+    h.count = 0;
+    CHECK(!opens(&h));
+
+    h = good;
+    h.version = POINT_FILE_VERSION + 1;
+    CHECK(!opens(&h));
+
+    //count says more than the file holds
+    CHECK(writeFile(&good, good.count - 1, point_record_size(good.layout)));
+    point_file f;
+    CHECK(!point_file_open(&f, path));
+
+    //u16 refuses points it would have to clamp, the ones it takes read back
+    //within a quantization step
+    point_writer w;
+    Vertex inside[2] = { { { -1.0f, 0.25f }, { 1.0f, 0.0f, 0.0f } },
+        { { 1.0f, -0.5f }, { 0.0f, 1.0f, 0.0f } } };
+    CHECK(point_writer_open(&w, path, POINT_U16, 2, 0, 0));
+    CHECK(point_writer_append(&w, inside, 2));
+    CHECK(point_writer_close(&w));
+    Vertex back[2];
+    if (point_file_open(&f, path)) {
+        CHECK(point_file_read(&f, 0, 2, back));
+        for (int i = 0; i < 2; i++) {
+            for (int k = 0; k < 2; k++) {
+                CHECK(fabsf(back[i].pos[k] - inside[i].pos[k]) <= 2.0f / 65535.0f);
+            }
+        }
+        point_file_close(&f);
+    } else {
+        CHECK(!"u16 file didn't open");
+    }
+
+    Vertex outside = { { 1.5f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+    CHECK(point_writer_open(&w, path, POINT_U16, 1, 0, 0));
+    CHECK(!point_writer_append(&w, &outside, 1));
+    point_writer_close(&w);
+
+    //f16 has no box to stay in
+    CHECK(point_writer_open(&w, path, POINT_F16, 1, 0, 0));
+    CHECK(point_writer_append(&w, &outside, 1));
+    CHECK(point_writer_close(&w));
+
+    unlink(path);
+    if (failures) {
+        fprintf(stderr, "test_pointfile: %d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "test_pointfile: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+//--tiled: every tile has to show its own part of the view, not the whole of it
+#include "../camera.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+//what the vertex shader does with a world position
+static void project(const vertexParams* p, double x, double y, double* ndcX, double* ndcY) {
+    *ndcX = (x - p->center[0]) * p->zoom[0];
+    *ndcY = (y - p->center[1]) * p->zoom[1];
+}
+
+static int near(double a, double b) {
+    return fabs(a - b) < 1e-5;
+}
+
+int main() {
+    ctx* c = calloc(1, sizeof(ctx));
+    c->cfg.center[0] = 0.25;
+    c->cfg.center[1] = -0.5;
+    c->cfg.zoom = 2.0;
+    initCamera(c);
+
+    //a 3x2 grid of 100x100 tiles over a 300x200 image
+    c->swapchainExtent.width = 100;
+    c->swapchainExtent.height = 100;
+    cameraSetTile(c, 0, 0, 300, 200);
+    vertexParams first = cameraVertexParams(c);
+    uint64_t firstVersion = c->camera.version;
+    cameraSetTile(c, 100, 100, 300, 200);
+    vertexParams second = cameraVertexParams(c);
+
+    CHECK(c->camera.version != firstVersion);
+    CHECK(memcmp(&first, &second, sizeof(vertexParams)) != 0);
+
+    //the world point at the full view's top left corner is the first
+    //tile's top left corner and lies outside the second tile
+    double worldX = c->cfg.center[0] - 1.0 / c->cfg.zoom;
+    double worldY = c->cfg.center[1] - 1.0 / c->cfg.zoom;
+    double x, y;
+    project(&first, worldX, worldY, &x, &y);
+    CHECK(near(x, -1.0) && near(y, -1.0));
+    project(&second, worldX, worldY, &x, &y);
+    CHECK(x < -1.0 && y < -1.0);
+
+    //the view's center is the middle column's center and the second row's
+    //top edge, only the second tile covers it
+    project(&second, c->cfg.center[0], c->cfg.center[1], &x, &y);
+    CHECK(near(x, 0.0) && near(y, -1.0));
+    project(&first, c->cfg.center[0], c->cfg.center[1], &x, &y);
+    CHECK(x > 1.0);
+
+    free(c);
+    if (failures) {
+        fprintf(stderr, "test_tiles: %d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "test_tiles: ok\n");
+    return EXIT_SUCCESS;
+}
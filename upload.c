@@ -0,0 +1,369 @@
+#include "upload.h"
+#include "arena.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//flushes in flight before recording has to wait for the oldest one
+#define UPLOAD_BATCHES 4
+
+int uploadSupportsTimeline(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device, &props);
+    if (props.apiVersion < VK_API_VERSION_1_2) {
+        return false;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+    };
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &timelineFeatures,
+    };
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    return timelineFeatures.timelineSemaphore == VK_TRUE;
+}
+
+int createUploader(ctx* ctx) {
+    uploadState* u = &ctx->upload;
+    qfi indices;
+    findQueueFamilies(ctx->physicalDevice, ctx->surface, &indices);
+    u->transferFamily = indices.transferFamily;
+    u->graphicsFamily = indices.graphicsFamily;
+
+    u->numBatches = UPLOAD_BATCHES;
+    u->batches = calloc(u->numBatches, sizeof(uploadBatch));
+    u->acquireCommandBuffers = calloc(ctx->MAX_FRAMES_IN_FLIGHT, sizeof(VkCommandBuffer));
+    if (!u->batches || !u->acquireCommandBuffers) {
+        fprintf(stderr, "ERROR: Couldn't allocate upload state\n");
+        return false;
+    }
+
+    VkCommandBuffer commandBuffers[UPLOAD_BATCHES];
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx->transferCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = u->numBatches,
+    };
+    if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo, commandBuffers)
+            != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't allocate upload command buffers\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < u->numBatches; i++) {
+        u->batches[i].commandBuffer = commandBuffers[i];
+    }
+
+    if (u->transferFamily != u->graphicsFamily) {
+        allocInfo.commandPool = ctx->graphicsCommandPool;
+        allocInfo.commandBufferCount = ctx->MAX_FRAMES_IN_FLIGHT;
+        if (vkAllocateCommandBuffers(ctx->logicalDevice, &allocInfo,
+                    u->acquireCommandBuffers) != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't allocate upload acquire command buffers\n");
+            return false;
+        }
+    }
+
+    if (u->hasTimeline) {
+        VkSemaphoreTypeCreateInfo typeInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &typeInfo,
+        };
+        if (vkCreateSemaphore(ctx->logicalDevice, &semaphoreInfo, NULL, &u->timeline)
+                != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't create the upload timeline semaphore\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void releaseBatch(ctx* ctx, uploadBatch* b) {
+    for (uint32_t i = 0; i < b->numStaging; i++) {
+        vkDestroyBuffer(ctx->logicalDevice, b->staging[i], NULL);
+        arenaFree(ctx, &b->stagingMemory[i]);
+    }
+    b->numStaging = 0;
+    b->value = 0;
+}
+
+static uploadBatch* recordingBatch(ctx* ctx) {
+    uploadState* u = &ctx->upload;
+    uploadBatch* b = &u->batches[u->current];
+    if (u->recording) {
+        return b;
+    }
+
+    //the oldest flush, only still running when uploads outpace the queue
+    if (b->value) {
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &u->timeline,
+            .pValues = &b->value,
+        };
+        if (vkWaitSemaphores(ctx->logicalDevice, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't wait for an upload\n");
+            return NULL;
+        }
+    }
+    releaseBatch(ctx, b);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkResetCommandBuffer(b->commandBuffer, 0);
+    if (vkBeginCommandBuffer(b->commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't begin an upload command buffer\n");
+        return NULL;
+    }
+    u->recording = true;
+    return b;
+}
+
+//how the graphics queue reads a buffer of this usage
+static void readers(VkBufferUsageFlags usage, VkAccessFlags* access,
+        VkPipelineStageFlags* stages) {
+    *access = 0;
+    *stages = 0;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+        *access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        *stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+        *access |= VK_ACCESS_INDEX_READ_BIT;
+        *stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        *access |= VK_ACCESS_SHADER_READ_BIT;
+        *stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
+        *access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        *stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    }
+    if (!*stages) {
+        *access = VK_ACCESS_MEMORY_READ_BIT;
+        *stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+}
+
+int uploadCopy(ctx* ctx, VkBuffer src, VkDeviceSize srcOffset, VkBuffer dst,
+        VkDeviceSize dstOffset, VkDeviceSize size, VkBufferUsageFlags usage) {
+    uploadState* u = &ctx->upload;
+    uploadBatch* b = recordingBatch(ctx);
+    if (!b) {
+        return false;
+    }
+
+    VkBufferCopy copyRegion = {
+        .srcOffset = srcOffset,
+        .dstOffset = dstOffset,
+        .size = size,
+    };
+    vkCmdCopyBuffer(b->commandBuffer, src, dst, 1, &copyRegion);
+
+    VkAccessFlags access;
+    VkPipelineStageFlags stages;
+    readers(usage, &access, &stages);
+    u->stages |= stages;
+    u->copies++;
+    u->bytes += size;
+    if (u->transferFamily == u->graphicsFamily) {
+        return true;
+    }
+
+    //exclusive buffers change queue family with a matching release here and
+    //acquire on the graphics queue, after the semaphore wait
+    if (u->numAcquires == u->acquireCapacity) {
+        uint32_t capacity = u->acquireCapacity ? u->acquireCapacity * 2 : 16;
+        VkBufferMemoryBarrier* acquires = realloc(u->acquires,
+                capacity * sizeof(VkBufferMemoryBarrier));
+        if (!acquires) {
+            fprintf(stderr, "ERROR: Couldn't grow the upload barrier list\n");
+            return false;
+        }
+        u->acquires = acquires;
+        u->acquireCapacity = capacity;
+    }
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = 0,
+        .srcQueueFamilyIndex = u->transferFamily,
+        .dstQueueFamilyIndex = u->graphicsFamily,
+        .buffer = dst,
+        .offset = dstOffset,
+        .size = size,
+    };
+    vkCmdPipelineBarrier(b->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = access;
+    u->acquires[u->numAcquires++] = barrier;
+    u->acquireStages |= stages;
+    return true;
+}
+
+int uploadRetire(ctx* ctx, VkBuffer staging, memAlloc* memory) {
+    uploadBatch* b = recordingBatch(ctx);
+    if (!b) {
+        return false;
+    }
+    if (b->numStaging == b->stagingCapacity) {
+        uint32_t capacity = b->stagingCapacity ? b->stagingCapacity * 2 : 8;
+        VkBuffer* buffers = realloc(b->staging, capacity * sizeof(VkBuffer));
+        if (buffers) {
+            b->staging = buffers;
+        }
+        memAlloc* memories = realloc(b->stagingMemory, capacity * sizeof(memAlloc));
+        if (memories) {
+            b->stagingMemory = memories;
+        }
+        if (!buffers || !memories) {
+            fprintf(stderr, "ERROR: Couldn't grow the upload staging list\n");
+            return false;
+        }
+        b->stagingCapacity = capacity;
+    }
+    b->staging[b->numStaging] = staging;
+    b->stagingMemory[b->numStaging] = *memory;
+    b->numStaging++;
+    memset(memory, 0, sizeof(memAlloc));
+    return true;
+}
+
+int uploadFlush(ctx* ctx) {
+    uploadState* u = &ctx->upload;
+    if (!u->recording) {
+        return true;
+    }
+    uploadBatch* b = &u->batches[u->current];
+    u->recording = false;
+    u->current = (u->current + 1) % u->numBatches;
+    if (vkEndCommandBuffer(b->commandBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't record an upload command buffer\n");
+        return false;
+    }
+
+    uint64_t value = u->submitted + 1;
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value,
+    };
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = u->timeline ? &timelineInfo : NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &b->commandBuffer,
+        .signalSemaphoreCount = u->timeline ? 1 : 0,
+        .pSignalSemaphores = &u->timeline,
+    };
+    if (vkQueueSubmit(ctx->transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Couldn't submit uploads\n");
+        return false;
+    }
+    u->submits++;
+    u->submitted = value;
+
+    if (!u->timeline) {
+        vkQueueWaitIdle(ctx->transferQueue);
+        releaseBatch(ctx, b);
+        u->waited = value;
+        u->stages = 0;
+    } else {
+        b->value = value;
+    }
+    return true;
+}
+
+void uploadCollect(ctx* ctx) {
+    uploadState* u = &ctx->upload;
+    if (!u->timeline) {
+        return;
+    }
+    uint64_t reached;
+    if (vkGetSemaphoreCounterValue(ctx->logicalDevice, u->timeline, &reached)
+            != VK_SUCCESS) {
+        return;
+    }
+    for (uint32_t i = 0; i < u->numBatches; i++) {
+        if (u->batches[i].value && u->batches[i].value <= reached) {
+            releaseBatch(ctx, &u->batches[i]);
+        }
+    }
+}
+
+int uploadGraphicsWait(ctx* ctx, uint32_t frameSlot, uploadWait* wait) {
+    uploadState* u = &ctx->upload;
+    memset(wait, 0, sizeof(uploadWait));
+    if (!uploadFlush(ctx)) {
+        return false;
+    }
+
+    if (u->submitted > u->waited) {
+        wait->semaphore = u->timeline;
+        wait->value = u->submitted;
+        wait->stages = u->stages;
+        u->waited = u->submitted;
+        u->stages = 0;
+    }
+
+    if (u->numAcquires) {
+        VkCommandBuffer commandBuffer = u->acquireCommandBuffers[frameSlot];
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        vkResetCommandBuffer(commandBuffer, 0);
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't begin an upload acquire command buffer\n");
+            return false;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                u->acquireStages, 0, 0, NULL, u->numAcquires, u->acquires, 0, NULL);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            fprintf(stderr, "ERROR: Couldn't record an upload acquire command buffer\n");
+            return false;
+        }
+        u->numAcquires = 0;
+        u->acquireStages = 0;
+        wait->acquire = commandBuffer;
+    }
+    return true;
+}
+
+void uploadReport(ctx* ctx) {
+    uploadState* u = &ctx->upload;
+    fprintf(stdout, "uploads: %llu copies, %.1f MB in %llu submissions, %s\n",
+            (unsigned long long) u->copies, u->bytes / 1048576.0,
+            (unsigned long long) u->submits,
+            u->timeline ? "timeline semaphore" : "blocking");
+}
+
+void destroyUploader(ctx* ctx) {
+    uploadState* u = &ctx->upload;
+    if (ctx->transferQueue) {
+        vkQueueWaitIdle(ctx->transferQueue);
+    }
+    for (uint32_t i = 0; u->batches && i < u->numBatches; i++) {
+        releaseBatch(ctx, &u->batches[i]);
+        free(u->batches[i].staging);
+        free(u->batches[i].stagingMemory);
+    }
+    if (u->timeline) { vkDestroySemaphore(ctx->logicalDevice, u->timeline, NULL); }
+    free(u->batches);
+    free(u->acquires);
+    free(u->acquireCommandBuffers);
+}
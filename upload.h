@@ -0,0 +1,51 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "vulkan.h"
+
+//asynchronous copies on the transfer queue. copies are recorded into one of
+//a few reused command buffers and go out together on the next flush, which
+//signals a timeline semaphore instead of waiting for the queue. the graphics
+//submits wait on that semaphore on the gpu, so the cpu never blocks on an
+//upload unless every command buffer is still in flight. when the transfer
+//queue is from another family, buffers are released there and acquired by
+//the graphics queue. without timeline semaphores (vulkan 1.2) a flush waits
+//for the transfer queue like the old one-shot copies did
+
+//true if the device can be created with timelineSemaphore
+int uploadSupportsTimeline(VkPhysicalDevice device);
+
+//needs the command pools, before anything is uploaded
+int createUploader(ctx* ctx);
+
+//copies size bytes of src into dst. usage is dst's usage, it decides which
+//graphics stages wait for the copy
+int uploadCopy(ctx* ctx, VkBuffer src, VkDeviceSize srcOffset, VkBuffer dst,
+        VkDeviceSize dstOffset, VkDeviceSize size, VkBufferUsageFlags usage);
+//hands a staging buffer to the uploader, it's destroyed once every copy
+//recorded so far is done. memory is cleared
+int uploadRetire(ctx* ctx, VkBuffer staging, memAlloc* memory);
+
+//submits the copies recorded since the last flush
+int uploadFlush(ctx* ctx);
+//releases the staging buffers of finished flushes, never blocks
+void uploadCollect(ctx* ctx);
+
+//what the next graphics submit has to do for the uploads flushed so far.
+//flushes first. frameSlot's fence must have signalled
+typedef struct uploadWait {
+    //VK_NULL_HANDLE when everything is already waited for
+    VkSemaphore semaphore;
+    uint64_t value;
+    VkPipelineStageFlags stages;
+    //ownership acquires, submitted ahead of the frame. VK_NULL_HANDLE when
+    //there are none
+    VkCommandBuffer acquire;
+} uploadWait;
+int uploadGraphicsWait(ctx* ctx, uint32_t frameSlot, uploadWait* wait);
+
+//copies and submissions so far
+void uploadReport(ctx* ctx);
+void destroyUploader(ctx* ctx);
+
+#endif
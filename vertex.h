@@ -0,0 +1,39 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <stdint.h>
+
+typedef struct Vertex {
+    float pos[2];
+    float color[3];
+} Vertex;
+
+//--vertex-format packed: 8 instead of 20 bytes. snorm16 position (every
+//point lies in [-1,1]) and unorm8 color, expanded to floats by the vertex
+//fetch (R16G16_SNORM, R8G8B8A8_UNORM) so the same vertex shader reads both
+typedef struct PackedVertex {
+    int16_t pos[2];
+    uint8_t color[4];
+} PackedVertex;
+
+//the same conversions as glsl's packSnorm2x16 / packUnorm4x8, so cpu and gpu
+//generated points pack the same way
+static inline int16_t packSnorm16(float v) {
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t) (v * 32767.0f + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+static inline uint8_t packUnorm8(float v) {
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint8_t) (v * 255.0f + 0.5f);
+}
+
+static inline PackedVertex packVertex(float x, float y, float r, float g, float b) {
+    PackedVertex p = {
+        .pos = { packSnorm16(x), packSnorm16(y) },
+        .color = { packUnorm8(r), packUnorm8(g), packUnorm8(b), 255 },
+    };
+    return p;
+}
+
+#endif
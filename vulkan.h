@@ -2,6 +2,9 @@
 #define VULKAN_H
 
 #include "math.h"
+#include "chaos.h"
+#include "config.h"
+#include "vertex.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -9,9 +12,295 @@
 #ifndef VERT_SHADER
 #define VERT_SHADER "./shaders/vert.spv"
 #endif
+#ifndef INSTANCED_VERT_SHADER
+#define INSTANCED_VERT_SHADER "./shaders/instanced_vert.spv"
+#endif
 #ifndef FRAG_SHADER
 #define FRAG_SHADER "./shaders/frag.spv"
 #endif
+#ifndef COMP_SHADER
+#define COMP_SHADER "./shaders/comp.spv"
+#endif
+#ifndef TONEMAP_VERT_SHADER
+#define TONEMAP_VERT_SHADER "./shaders/tonemap_vert.spv"
+#endif
+#ifndef TONEMAP_FRAG_SHADER
+#define TONEMAP_FRAG_SHADER "./shaders/tonemap_frag.spv"
+#endif
+#ifndef PRESENT_FRAG_SHADER
+#define PRESENT_FRAG_SHADER "./shaders/present_frag.spv"
+#endif
+
+//a piece of a device memory block, see arena.c
+typedef struct memBlock memBlock;
+typedef struct memAlloc {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    //NULL unless the memory type is host visible
+    void* mapped;
+    memBlock* block;
+} memAlloc;
+
+typedef struct memArena {
+    VkPhysicalDeviceMemoryProperties props;
+    //host visible memory that isn't coherent is handed out in whole atoms,
+    //so flushes and invalidations of a piece never touch its neighbours
+    VkDeviceSize nonCoherentAtomSize;
+    memBlock* blocks;
+    uint32_t numBlocks;
+    uint32_t numAllocs;
+    VkDeviceSize reserved;
+    VkDeviceSize used;
+    VkDeviceSize peakReserved;
+} memArena;
+
+//push constants of the vertex shaders, gl_Position = (pos - center) * zoom
+typedef struct vertexParams {
+    float center[2];
+    //per axis, a --tiled tile stretches the view unevenly
+    float zoom[2];
+    //instanced.vert.glsl: base 3 digits of the instance index to decode
+    uint32_t depth;
+} vertexParams;
+
+//pan and zoom, see camera.c. doubles so --render lod can go far past where
+//float positions run out of precision
+typedef struct cameraState {
+    double center[2];
+    double zoom;
+    //bumped on every change, anything derived from the view compares it
+    uint64_t version;
+    //the part of the view actually drawn, see cameraSetTile
+    double regionOffset[2];
+    double regionScale[2];
+    uint32_t dragging;
+    double dragX;
+    double dragY;
+} cameraState;
+
+//--render lod, see lod.c
+typedef struct lodState {
+    //MAX_FRAMES_IN_FLIGHT slices of LOD_MAX_TRIANGLES triangles
+    VkBuffer ringBuffer;
+    memAlloc ringMemory;
+    void* ringMapped;
+    uint32_t* slotTriangles;
+    //camera version each slice was generated for
+    uint64_t* slotVersion;
+    //threshold of the last generated slice, cfg.lodPixels or coarser when
+    //the finer one didn't fit
+    float pixels;
+} lodState;
+
+//--resident-points, see stream.c
+typedef struct streamChunk {
+    //pool slot, -1 when not resident
+    int32_t slot;
+    uint32_t count;
+    //known once the chunk has been read, until then it counts as visible
+    uint32_t hasBounds;
+    float min[2];
+    float max[2];
+    //stream frame the chunk was last drawn or loaded in
+    uint64_t lastUsed;
+} streamChunk;
+
+typedef struct streamState {
+    streamChunk* chunks;
+    uint64_t numChunks;
+    uint32_t chunkPoints;
+    //numSlots slots of chunkPoints vertices
+    VkBuffer pool;
+    memAlloc poolMemory;
+    uint32_t numSlots;
+    //chunk in each slot, -1 when free
+    int64_t* slotChunk;
+    //MAX_FRAMES_IN_FLIGHT slices of numSlots VkDrawIndirectCommand
+    VkBuffer drawBuffer;
+    memAlloc drawMemory;
+    uint32_t* slotDraws;
+    uint32_t multiDraw;
+    uint64_t frame;
+
+    uint64_t loads;
+    uint64_t evictions;
+    uint64_t bytes;
+} streamState;
+
+//--pipeline-cache, see pipelinecache.c
+typedef struct pipelineCacheState {
+    VkPipelineCache cache;
+    //what the file held, so an unchanged cache isn't written again
+    uint64_t loadedChecksum;
+    size_t loadedBytes;
+    //time spent in vkCreate*Pipelines, for the startup report
+    double createMs;
+} pipelineCacheState;
+
+//transfer queue copies, see upload.c
+typedef struct uploadBatch {
+    VkCommandBuffer commandBuffer;
+    //timeline value signalled when the batch is done, 0 unless in flight
+    uint64_t value;
+    //destroyed once value is reached
+    VkBuffer* staging;
+    memAlloc* stagingMemory;
+    uint32_t numStaging;
+    uint32_t stagingCapacity;
+} uploadBatch;
+
+typedef struct uploadState {
+    uint32_t hasTimeline;
+    //VK_NULL_HANDLE without timeline semaphore support
+    VkSemaphore timeline;
+    uint32_t transferFamily;
+    uint32_t graphicsFamily;
+    uploadBatch* batches;
+    uint32_t numBatches;
+    uint32_t current;
+    uint32_t recording;
+    //value of the last flush, and the last one a graphics submit waited for
+    uint64_t submitted;
+    uint64_t waited;
+    //graphics stages reading what was uploaded since the last wait
+    VkPipelineStageFlags stages;
+    //queue family ownership acquires for the next graphics submit, one
+    //command buffer per frame slot
+    VkBufferMemoryBarrier* acquires;
+    uint32_t numAcquires;
+    uint32_t acquireCapacity;
+    VkPipelineStageFlags acquireStages;
+    VkCommandBuffer* acquireCommandBuffers;
+
+    uint64_t copies;
+    uint64_t bytes;
+    uint64_t submits;
+} uploadState;
+
+//per-run totals gathered by the benchmark queries, see bench.c
+typedef struct benchStats {
+    VkQueryPool statsQueryPool;
+    VkQueryPool timestampQueryPool;
+    uint32_t hasPipelineStatistics;
+    uint32_t hasTimestamps;
+    float timestampPeriod;
+    //timestampValidBits of the graphics queue family
+    uint64_t timestampMask;
+    uint32_t* slotPending;
+
+    uint64_t frames;
+    uint64_t inputVertices;
+    uint64_t vertexInvocations;
+    uint64_t maxInputVertices;
+    double gpuMs;
+    double cpuMs;
+    double lastFrameStart;
+} benchStats;
+
+//compute generator, see gpugen.c
+typedef struct gpugenState {
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    //cfg.fractal's maps and alias table, binding 1
+    VkBuffer ifsBuffer;
+    memAlloc ifsMemory;
+    //drawSlots VkDrawIndirectCommands the shader counts into, binding 2
+    VkBuffer drawBuffer;
+    memAlloc drawMemory;
+    uint32_t drawSlots;
+    VkBool32 cull;
+    uint32_t nextWalker;
+    //0 unless binning into a histogram
+    uint32_t histogramWidth;
+    uint32_t histogramHeight;
+} gpugenState;
+
+//--progressive N, see progressive.c
+typedef struct progressiveState {
+    //MAX_FRAMES_IN_FLIGHT slices of pointsPerFrame vertices, one per frame slot
+    VkBuffer ringBuffer;
+    memAlloc ringMemory;
+    void* ringMapped;
+    uint32_t* slotCount;
+    uint64_t generated;
+    chaos_engine engine;
+    //camera version the image is being refined for, clear is set when it
+    //changed and the next pass has to start from black
+    uint64_t cameraVersion;
+    uint32_t clear;
+
+    //never cleared between frames, copied to the swapchain image every frame
+    VkImage accumImage;
+    memAlloc accumMemory;
+    VkImageView accumView;
+    VkFramebuffer accumFramebuffer;
+    VkRenderPass accumRenderPass;
+    VkRenderPass accumClearRenderPass;
+
+    //set by createSwapchain when the surface allows transfer writes.
+    //otherwise a fullscreen pass samples the image into the swapchain image
+    uint32_t copyToSwapchain;
+    VkSampler sampler;
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkPipelineLayout presentLayout;
+    VkPipeline presentPipeline;
+} progressiveState;
+
+//--render histogram, see histogram.c
+typedef struct histogramState {
+    VkBuffer buffer;
+    memAlloc memory;
+    uint32_t width;
+    uint32_t height;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+} histogramState;
+
+//frame command buffer reuse and --record-threads, see record.c
+typedef struct recordWorker recordWorker;
+typedef struct recordState {
+    //MAX_FRAMES_IN_FLIGHT * numImages primaries, slot major
+    VkCommandBuffer* buffers;
+    //camera version + 1 each one was recorded for, 0 when stale
+    uint64_t* stamps;
+    uint32_t numImages;
+    recordWorker* workers;
+    uint32_t numWorkers;
+    //the swapchain image the workers record for
+    uint32_t image;
+    uint64_t recorded;
+    uint64_t reused;
+    double recordMs;
+} recordState;
+
+//--headless, see headless.c
+typedef struct readbackSlot readbackSlot;
+typedef struct headlessState {
+    //one offscreen image per frame slot, they stand in for the swapchain images
+    memAlloc* imageMemory;
+
+    //host visible ring the frames are copied into, each slot is either free,
+    //being copied or being encoded
+    readbackSlot* slots;
+    uint32_t numSlots;
+    uint32_t coherent;
+    //per frame slot: the copy into the ring, and which ring slot it targets
+    VkCommandBuffer* copyCommandBuffers;
+    int32_t* pendingSlot;
+    //--tiled: frame i is tile i, row by row
+    uint32_t tilesAcross;
+    uint32_t tilesDown;
+} headlessState;
 
 typedef struct ctx {
     GLFWwindow* window;
@@ -35,10 +324,13 @@ typedef struct ctx {
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
+    //same state as graphicsPipeline but a triangle list, --render subdivision
+    VkPipeline trianglePipeline;
+    //triangle list with instanced.vert.glsl, --render instanced
+    VkPipeline instancedPipeline;
     VkCommandPool graphicsCommandPool;
     VkCommandPool transferCommandPool;
     
-    VkCommandBuffer* commandBuffers;
     VkSemaphore* imageAvailableSemaphores;
     VkSemaphore* renderFinishedSemaphores;
     VkFence* inFlightFences;
@@ -47,8 +339,36 @@ typedef struct ctx {
     uint32_t currentFrame;
     uint32_t framebufferResized;
 
+    //device local memory is also host visible, skip staging copies
+    uint32_t unifiedMemory;
+
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    memAlloc vertexBufferMemory;
+    //--render subdivision draws vertexBuffer through this
+    VkBuffer indexBuffer;
+    memAlloc indexBufferMemory;
+    uint32_t numIndices;
+    //--render instanced, 3^depth copies of the one triangle in vertexBuffer
+    uint32_t numInstances;
+    //most input vertices a frame can submit, what bench checks against. the
+    //point count unless the render mode draws something else
+    uint32_t benchVertices;
+
+    config cfg;
+    memArena arena;
+    uploadState upload;
+    recordState record;
+    pipelineCacheState pipelineCache;
+    cameraState camera;
+    lodState lod;
+    streamState stream;
+    benchStats bench;
+    gpugenState gpugen;
+    progressiveState progressive;
+    histogramState histogram;
+    headlessState headless;
+    //--load-points
+    point_file pointFile;
 } ctx;
 
 typedef struct qfi {
@@ -60,11 +380,31 @@ typedef struct qfi {
     uint32_t hasTransfer;
 } qfi;
 
-typedef struct Vertex {
-    float pos[2];
-    float color[3];
-} Vertex;
-
 int run();
 
+//shared with the other vulkan modules, defined in main.c
+void findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface, qfi* indices);
+int createShader(VkDevice device, char* path, VkShaderModule* shader);
+int findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties,
+        VkPhysicalDevice device, uint32_t* out);
+int createBuffer(ctx* ctx, VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties, VkBuffer* buffer, memAlloc* bufferMemory);
+int createImage(ctx* ctx, uint32_t width, uint32_t height, VkFormat format,
+        VkImageUsageFlags usage, VkImage* image, memAlloc* imageMemory);
+int createImageView(ctx* ctx, VkImage image, VkFormat format, VkImageView* view);
+VkCommandBuffer beginSingleTimeCommands(ctx* ctx, VkCommandPool pool);
+
+//fills size bytes of freshly mapped memory, returns false on failure
+typedef int (*uploadFillFn)(void* dst, VkDeviceSize size, void* user);
+int createDeviceLocalBuffer(ctx* ctx, VkDeviceSize size, VkBufferUsageFlags usage,
+        uploadFillFn fill, void* user, VkBuffer* buffer, memAlloc* bufferMemory);
+int recordCommandBuffer(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t imageIndex);
+//the point set pass's state and draws, part of parts of them
+void recordPointSetDraws(ctx* ctx, VkCommandBuffer commandBuffer, uint32_t part,
+        uint32_t parts);
+//bytes per point in every vertex buffer, Vertex or PackedVertex
+VkDeviceSize vertexStride(ctx* ctx);
+int endSingleTimeCommands(ctx* ctx, VkCommandPool pool, VkQueue queue,
+        VkCommandBuffer commandBuffer);
+
 #endif